@@ -4,8 +4,44 @@ frameLimit = true
 -- each 1x1 block (wall, ceiling, floor) will have NxN light map
 shadowResolution = 16
 
+-- light is calculated for every Nth pixel in both directions and filled in between, 1 lights every pixel
+-- values above 1 turn on the deferred lighting
+lightingScale = 1
+
 -- how many neighbour portals should be crossed by light
 shadowDepth = 16
 
+-- light map resolution and depth used when a sector is seen for the first time, the full quality light maps are baked
+-- in the background one sector at a time while the player stands still, 0 always bakes the full quality light maps at
+-- once
+coarseShadowResolution = 4
+coarseShadowDepth = 2
+
+-- number of threads used for rendering, 0 uses all hardware threads
+workerThreads = 0
+
+-- number of threads baking light maps of sectors about to be seen, separate from the rendering ones
+prefetchThreads = 1
+
+-- number of vertical screen strips rendered in parallel, 1 renders the whole screen at once
+renderStrips = 16
+
+-- megabytes of memory for walls, ceilings and floors with the lights applied to their textures, 0 disables the cache
+surfaceCacheSize = 0
+
+-- light only the pixels left visible after the whole frame is drawn, the surface cache is not used in this mode
+deferredLighting = false
+
+-- size of the rendered frame, which is then scaled to the window
+renderWidth = 692
+renderHeight = 384
+
+-- milliseconds the rendering of a frame should take, the resolution is lowered when it takes longer
+-- 0 always renders at full resolution
+targetFrameTime = 0
+
+-- lowest resolution used to meet targetFrameTime, relative to renderWidth and renderHeight
+minimumRenderScale = 0.5
+
 -- show rendering statistics
 renderStats = true
@@ -0,0 +1,83 @@
+#include "engine/lighting.hpp"
+#include "engine/shading.hpp"
+
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+namespace
+{
+constexpr auto runs        = 4096;
+constexpr auto repetitions = 200;
+
+template<typename Kernel>
+double measure(const Kernel& kernel)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int repetition = 0; repetition < repetitions; ++repetition)
+    {
+        for (int run = 0; run < runs; ++run)
+        {
+            kernel(run);
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (double)runs * repetitions * engine::LightSamples::capacity / elapsed / 1e6;
+}
+} // namespace
+
+int main()
+{
+    constexpr auto capacity = engine::LightSamples::capacity;
+
+    std::mt19937 random{};
+    std::uniform_int_distribution<sdl::Pixel> pixel{};
+    std::uniform_real_distribution<float> intensity{0.0f, 1.2f};
+
+    std::vector<sdl::Pixel> texels(runs * capacity);
+    std::vector<sdl::Pixel> shaded(runs * capacity);
+    std::vector<engine::LightSamples> light(runs);
+    for (int run = 0; run < runs; ++run)
+    {
+        for (int i = 0; i < capacity; ++i)
+        {
+            texels[run * capacity + i] = pixel(random);
+            light[run].r[i]            = intensity(random);
+            light[run].g[i]            = intensity(random);
+            light[run].b[i]            = intensity(random);
+        }
+    }
+    engine::LightPoint uniform{0.7, 0.8, 0.9};
+
+    auto perPixel = [&](auto kernel)
+    {
+        return [&, kernel](int run)
+        { kernel(&texels[run * capacity], light[run], capacity, &shaded[run * capacity]); };
+    };
+    auto constant = [&](auto kernel)
+    {
+        return [&, kernel](int run) { kernel(&texels[run * capacity], uniform, capacity, &shaded[run * capacity]); };
+    };
+
+    using PerPixelKernel = void (*)(const sdl::Pixel*, const engine::LightSamples&, int, sdl::Pixel*);
+    using ConstantKernel = void (*)(const sdl::Pixel*, const engine::LightPoint&, int, sdl::Pixel*);
+
+    // Measured outside of the logging macros, which may be compiled out
+    auto perPixelScalar     = measure(perPixel((PerPixelKernel)engine::shadePixelsScalar));
+    auto perPixelVectorized = measure(perPixel((PerPixelKernel)engine::shadePixels));
+    auto constantScalar     = measure(constant((ConstantKernel)engine::shadePixelsScalar));
+    auto constantVectorized = measure(constant((ConstantKernel)engine::shadePixels));
+
+    // Keeps the compiler from dropping the work as unused
+    volatile auto checksum = std::accumulate(shaded.begin(), shaded.end(), sdl::Pixel{});
+
+    SPDLOG_INFO("Per pixel light, scalar:     {:8.1f} Mpx/s", perPixelScalar);
+    SPDLOG_INFO("Per pixel light, vectorized: {:8.1f} Mpx/s", perPixelVectorized);
+    SPDLOG_INFO("Constant light, scalar:      {:8.1f} Mpx/s", constantScalar);
+    SPDLOG_INFO("Constant light, vectorized:  {:8.1f} Mpx/s", constantVectorized);
+    SPDLOG_INFO("Checksum {}", (sdl::Pixel)checksum);
+
+    return 0;
+}
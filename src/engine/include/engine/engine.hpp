@@ -1,16 +1,24 @@
 #pragma once
 
 #include "lighting.hpp"
+#include "mipmapped_texture.hpp"
+#include "potentially_visible_set.hpp"
+#include "resolution_controller.hpp"
 #include "sdlwrapper/common_types.hpp"
 #include "sdlwrapper/surface.hpp"
 #include "sdlwrapper/texture.hpp"
+#include "surface_cache.hpp"
+#include "thread_pool.hpp"
 #include "util/constants.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <map>
+#include <optional>
 #include <queue>
-#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace game
 {
@@ -41,62 +49,309 @@ class Engine
         double offsetX{0}, offsetY{0}, offsetZ{0}, offsetAngle{0};
     };
 
+    // Visible rows of a sector's ceiling or floor, one range per screen column
+    struct PlaneColumns
+    {
+        std::vector<int> top, bottom;
+    };
+
+    // Horizontal run of a plane at a single screen row, constant depth along it
+    struct Span
+    {
+        int y, xStart, xEnd;
+    };
+
+    // Light reaching a wall, plane or sprite, referenced by its pixels until the deferred lighting pass
+    struct LightSource
+    {
+        const LightMap* wallMap{};
+        const OffsetLightMap* surfaceMap{};
+        LightPoint uniform{}; // used when there is no light map
+        LightPoint playerIntensity{};
+    };
+
+    // Light sampled at every c::lightingScale-th pixel of a strip in both directions, plus its last column and row
+    struct LightingGrid
+    {
+        struct Neighbours
+        {
+            int first, second;
+            double weight; // of the second one
+        };
+
+        int leftX{}, rightX{}, height{};
+        int columns{}, rows{};
+        std::vector<float> r{}, g{}, b{};
+
+        [[nodiscard]] int x(int column) const
+        {
+            return std::min(leftX + column * c::lightingScale, rightX);
+        }
+
+        [[nodiscard]] int y(int row) const
+        {
+            return std::min(row * c::lightingScale, height - 1);
+        }
+
+        [[nodiscard]] int pixel(int column, int row) const
+        {
+            return y(row) + x(column) * height;
+        }
+
+        [[nodiscard]] int slot(int column, int row) const
+        {
+            return row + column * rows;
+        }
+
+        [[nodiscard]] Neighbours columnsAround(int pixelX) const
+        {
+            auto first  = (pixelX - leftX) / c::lightingScale;
+            auto second = std::min(first + 1, columns - 1);
+            return {first, second, second > first ? (pixelX - x(first)) / (double)(x(second) - x(first)) : 0};
+        }
+
+        [[nodiscard]] Neighbours rowsAround(int pixelY) const
+        {
+            auto first  = pixelY / c::lightingScale;
+            auto second = std::min(first + 1, rows - 1);
+            return {first, second, second > first ? (pixelY - y(first)) / (double)(y(second) - y(first)) : 0};
+        }
+    };
+
+    // Per-thread state of a vertical screen strip rendered independently of the others
+    struct RenderStrip
+    {
+        std::vector<int> spanStart{};
+        std::vector<Span> spans{};
+        std::vector<LightSource> lightSources{};
+        LightingGrid lightingGrid{};
+        uint64_t geometryTime{}, spritesTime{};
+    };
+
+    // Per-pixel inputs of the deferred lighting pass, in addition to the texels and depths kept in the buffers
+    struct GeometryBuffer
+    {
+        std::vector<int> source{}; // index of the strip light source, -1 if empty
+        std::vector<float> u{}, v{};
+        std::vector<float> playerDistance{};
+    };
+
+    // Visible pixels of a wall column, plane span or sprite, waiting to be lit and shaded together
+    struct ShadingBatch
+    {
+        LightSamples light;
+        std::array<double, LightSamples::capacity> playerDistance; // squared, for the player light
+        std::array<sdl::Pixel, LightSamples::capacity> texels, shaded;
+        std::array<int, LightSamples::capacity> indices;
+        std::array<double, LightSamples::capacity> distances;
+        int count{0};
+    };
+
+    // Pre-lit ceiling or floor, one for every mip level used by its spans
+    using LitSurfaces = std::vector<std::shared_ptr<const SurfaceCache::LitSurface>>;
+
+    // Wall in camera space, clipped to the near plane, and its extent on the screen
+    struct WallProjection
+    {
+        double wallStartX, wallStartY, wallEndX, wallEndY;
+        double transformedLeftX, transformedLeftZ, transformedRightX, transformedRightZ;
+        double boundaryLeft, boundaryRight;
+        int leftX, rightX;
+        int beginX, endX;
+    };
+
+    // Everything the rendered frame depends on, compared between frames to skip rendering the same one again
+    struct FrameFingerprint
+    {
+        int sector;
+        double x, y, z, angle, fovH, fovV;
+        uint64_t lightingRevision;
+        int width, height;
+
+        bool operator==(const FrameFingerprint&) const = default;
+    };
+
+    // Screen rows of the wall edges and, for a portal, of the opening into the neighbouring sector, at both wall ends
+    struct WallRows
+    {
+        int leftX, rightX;
+        int leftTop, leftBottom, rightTop, rightBottom;
+        int neighbourLeftTop, neighbourLeftBottom, neighbourRightTop, neighbourRightBottom;
+
+        [[nodiscard]] int interpolate(int x, int left, int right) const
+        {
+            return (x - leftX) * (right - left) / (rightX - leftX) + left;
+        }
+
+        [[nodiscard]] int top(int x) const { return interpolate(x, leftTop, rightTop); }
+
+        [[nodiscard]] int bottom(int x) const { return interpolate(x, leftBottom, rightBottom); }
+
+        [[nodiscard]] int neighbourTop(int x) const { return interpolate(x, neighbourLeftTop, neighbourRightTop); }
+
+        [[nodiscard]] int neighbourBottom(int x) const
+        {
+            return interpolate(x, neighbourLeftBottom, neighbourRightBottom);
+        }
+    };
+
 public:
 
     Engine(sdl::Renderer& renderer, world::Level& level);
 
-    void frame(const game::Position& player);
+    void frame(const game::Position& position);
     void draw();
 
+    // Prepares the light maps needed to render the view from the position at the end of the queued moves
+    void prefetch(const game::Position& destination);
+
     void preload();
 
 private:
 
-    sdl::Surface& getTexture(const std::string& name);
+    // The buffers are column-major, so that drawing wall columns walks consecutive addresses and every screen strip
+    // owns a contiguous part of them
+    [[nodiscard]] int pixelIndex(int x, int y) const
+    {
+        return y + x * frameHeight;
+    }
+
+    sdl::Surface& getTexture(int handle);
+    const MipmappedTexture& getMipmaps(int handle);
+    void updateTextures(bool showProgress);
 
-    void renderWall(const world::Sector& sector,
+    void resolveVisibility(const game::Position& player);
+    void refineLighting();
+    void renderStrip(RenderStrip& strip, const game::Position& player, int leftX, int rightX);
+    std::optional<WallProjection> projectWall(const SectorRenderParams& renderParameters,
+                                              const world::Wall& wall,
+                                              const game::Position& player,
+                                              double angleSin,
+                                              double angleCos);
+    WallRows projectRows(const SectorRenderParams& renderParameters,
+                         const world::Sector& sector,
+                         const world::Wall& wall,
+                         const game::Position& player,
+                         const WallProjection& projection);
+    [[nodiscard]] std::pair<int, int> portalOpening(const WallRows& rows, int x, int top, int bottom) const;
+    void renderWall(RenderStrip& strip,
+                    const SectorRenderParams& renderParameters,
+                    const world::Sector& sector,
                     const world::Wall& wall,
                     const game::Position& player,
                     double angleSin,
+                    double angleCos);
+    void clearPlanes(const SectorRenderParams& renderParameters);
+    void renderPlane(RenderStrip& strip,
+                     const SectorRenderParams& renderParameters,
+                     const game::Position& player,
+                     const PlaneColumns& columns,
+                     int surface,
+                     double planeY,
+                     double angleSin,
+                     double angleCos,
+                     const MipmappedTexture& texture,
+                     const OffsetLightMap& lightMap);
+    void renderSpan(const SectorRenderParams& renderParameters,
+                    const game::Position& player,
+                    const Span& span,
+                    double planeY,
+                    double angleSin,
                     double angleCos,
-                    const OffsetLightMap& ceilingLightMap,
-                    const OffsetLightMap& floorLightMap);
-    void renderCeilingAndFloor(const world::Sector& sector,
-                               const game::Position& player,
-                               int x,
-                               int wallTop,
-                               int wallBottom,
-                               double ceilingY,
-                               double floorY,
-                               double angleSin,
-                               double angleCos,
-                               const OffsetLightMap& ceilingLightMap,
-                               const OffsetLightMap& floorLightMap);
-    void renderSprites(const world::Sector& sector, const game::Position& player, double angleSin, double angleCos);
+                    const MipmappedTexture& texture,
+                    const OffsetLightMap& lightMap,
+                    int lightSource,
+                    const LitSurfaces& litSurfaces);
+    void renderSprites(RenderStrip& strip,
+                       const SectorRenderParams& renderParameters,
+                       const world::Sector& sector,
+                       const game::Position& player,
+                       double angleSin,
+                       double angleCos);
+    void litLine(int x,
+                 double wallProgress,
+                 int wallTop,
+                 int wallBottom,
+                 int visibleWallTop,
+                 int visibleWallBottom,
+                 const SurfaceCache::LitSurface& surface,
+                 const MipmappedTexture::Level& mip,
+                 double distance,
+                 double playerDistanceXY,
+                 double ceilingY,
+                 double floorY);
+    std::shared_ptr<const SurfaceCache::LitSurface> litWall(const world::Sector& sector,
+                                                            const world::Wall& wall,
+                                                            const MipmappedTexture& texture,
+                                                            int mipLevel);
+    std::shared_ptr<const SurfaceCache::LitSurface> litPlane(const world::Sector& sector,
+                                                             int surface,
+                                                             const MipmappedTexture& texture,
+                                                             int mipLevel);
+    void buildLitSurfaces();
+    SurfaceCache::LitSurface buildLitWall(const world::Sector& sector,
+                                          const world::Wall& wall,
+                                          const MipmappedTexture::Level& mip,
+                                          const LightMap& lightMap);
+    SurfaceCache::LitSurface buildLitPlane(const world::Sector& sector,
+                                           const MipmappedTexture::Level& mip,
+                                           const OffsetLightMap& lightMap);
+    void addPlayerLight(ShadingBatch& batch, const LightPoint& playerIntensity);
+    void shadeBatch(ShadingBatch& batch, const LightPoint& playerIntensity);
+    void storeBatch(ShadingBatch& batch);
+    int addLightSource(RenderStrip& strip, const LightSource& source);
+    void deferBatch(ShadingBatch& batch, int lightSource);
+    template<typename LightBatch>
+    void collectDeferred(ShadingBatch& batch, int& batchSource, int index, int slot, const LightBatch& lightBatch);
+    void gatherLight(ShadingBatch& batch, const LightSource& source);
+    void storeLit(ShadingBatch& batch);
+    void lightDeferred(RenderStrip& strip, int leftX, int rightX);
+    void sampleLighting(RenderStrip& strip, int leftX, int rightX);
+    void upsampleLighting(RenderStrip& strip, int leftX, int rightX);
     void lightedLine(int x,
                      double xProgress,
                      int wallTop,
                      int wallBottom,
                      int visibleWallTop,
                      int visibleWallBottom,
-                     sdl::Surface& texture,
+                     const MipmappedTexture& texture,
                      int textureX,
+                     double texelsPerColumn,
                      double distance,
-                     const LightMap& lightMap);
+                     const LightMap& lightMap,
+                     int lightSource,
+                     double playerDistanceXY,
+                     double ceilingY,
+                     double floorY);
 
-    std::map<std::string, sdl::Surface> textures{};
+    std::vector<sdl::Surface> textures{};
+    std::vector<MipmappedTexture> mipmaps{};
+    uint64_t texturesRevision{};
     std::map<std::string, sdl::Surface> sprites{};
-    std::array<int, c::renderWidth> limitTop{}, limitBottom{};
-    std::array<sdl::Pixel, c::renderWidth * c::renderHeight> buffer{};
-    std::array<double, c::renderWidth * c::renderHeight> zBuffer{};
+    int frameWidth{c::renderWidth}, frameHeight{c::renderHeight};
+    std::vector<int> limitTop{}, limitBottom{};
+    PlaneColumns coverage{}, ceilingColumns{}, floorColumns{};
+    std::vector<sdl::Pixel> buffer{};
+    std::vector<double> zBuffer{};
+    GeometryBuffer geometryBuffer{};
+    std::vector<sdl::Pixel> frameBuffer{};
+    std::optional<FrameFingerprint> lastFrame{};
+    bool frameRendered{false};
     std::queue<SectorRenderParams> renderQueue{};
+    std::vector<SectorRenderParams> visibleSectors{};
+    std::vector<RenderStrip> strips{};
 
     sdl::Renderer& renderer;
     sdl::Texture view;
 
     world::Level& level;
 
+    ThreadPool pool;
     Lighting lighting;
+    PotentiallyVisibleSet visibility;
+    SurfaceCache surfaceCache;
+    bool deferLighting;
+    ResolutionController resolution;
 };
 
 extern uint64_t lightingTime;
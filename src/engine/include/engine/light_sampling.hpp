@@ -0,0 +1,18 @@
+#pragma once
+
+namespace engine
+{
+class LightMap;
+struct LightSamples;
+
+/**
+ * @brief Bilinearly interpolates a light map at a run of points.
+ * @param lightMap Light map to be sampled, at least two texels wide and high.
+ * @param samples Points to be sampled, in light map texel coordinates; the results are written back to it.
+ * @param count Number of samples to process.
+ *
+ * Coordinates outside of the light map are clamped to its edges. Depending on the instruction
+ * set the engine is built for, eight (AVX2), four (SSE2) or one sample is processed at a time.
+ */
+void sampleLightMap(const LightMap& lightMap, LightSamples& samples, int count);
+} // namespace engine
@@ -1,16 +1,15 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <memory>
 #include <optional>
-#include <queue>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-namespace
-{
-struct GatheredSector;
-}
-
 namespace game
 {
 class Position;
@@ -32,13 +31,15 @@ class Wall;
 
 namespace engine
 {
+class ThreadPool;
+
 class LightPoint
 {
 public:
 
     double r, g, b;
 
-    LightPoint& operator+=(const LightPoint& other)
+    constexpr LightPoint& operator+=(const LightPoint& other)
     {
         r += other.r;
         g += other.g;
@@ -46,7 +47,7 @@ public:
         return *this;
     }
 
-    LightPoint& operator*=(double scalar)
+    constexpr LightPoint& operator*=(double scalar)
     {
         r *= scalar;
         g *= scalar;
@@ -54,77 +55,269 @@ public:
         return *this;
     }
 
-    friend LightPoint operator+(LightPoint lhs, const LightPoint& rhs)
+    friend constexpr LightPoint operator+(LightPoint lhs, const LightPoint& rhs)
     {
         lhs += rhs;
         return lhs;
     }
 
-    friend LightPoint operator*(LightPoint lhs, double rhs)
+    friend constexpr LightPoint operator*(LightPoint lhs, double rhs)
     {
         lhs *= rhs;
         return lhs;
     }
 
-    friend LightPoint operator*(double lhs, LightPoint rhs)
+    friend constexpr LightPoint operator*(double lhs, LightPoint rhs)
     {
         rhs *= lhs;
         return rhs;
     }
 };
 
+/**
+ * @brief Light map stored in single precision, with each color channel in a separate plane.
+ *
+ * The values are stored already halved, the way they are applied when shading, so that
+ * the sampling kernels only need to interpolate them.
+ */
 class LightMap
 {
 public:
 
+    LightMap(int width, int height);
+
+    void store(int index, const LightPoint& lightPoint);
+
     int width, height;
-    std::vector<LightPoint> map;
+    std::vector<float> r, g, b;
 };
 
+/**
+ * @brief Light map of a ceiling or floor, with its first texel at (x, y) in the world and scale texels per unit.
+ */
 class OffsetLightMap : public LightMap
 {
 public:
 
     double x, y;
+    double scale;
+};
+
+/**
+ * @brief Light map coordinates of a run of adjacent pixels and the light sampled at them.
+ */
+struct LightSamples
+{
+    constexpr static auto capacity{64};
+
+    alignas(32) std::array<float, capacity> u, v;
+    alignas(32) std::array<float, capacity> r, g, b;
 };
 
+/**
+ * @brief Intensity of the player light when applied to walls.
+ */
+constexpr LightPoint playerWallLight{0.3, 0.3, 0.375};
+
+/**
+ * @brief Intensity of the player light when applied to ceilings and floors.
+ */
+constexpr LightPoint playerSurfaceLight{0.1, 0.1, 0.125};
+
+/**
+ * @brief Calculates the player light contribution at a given point.
+ * @param intensity Player light intensity.
+ * @param distanceSquared Squared distance between the camera and the lit point.
+ * @return Light to be added to the light map value at the point.
+ *
+ * The player light follows the camera, so it is not a part of the light maps and is
+ * evaluated analytically while shading. It is scaled the same way as the values
+ * interpolated from the light maps.
+ */
+constexpr LightPoint playerLighting(const LightPoint& intensity, double distanceSquared)
+{
+    return intensity * (0.5 / distanceSquared);
+}
+
+/**
+ * @class Lighting
+ * @brief Light maps calculator.
+ *
+ * The level lights never move, so the light maps containing their contribution are
+ * calculated once per sector and kept in a cache, which is flushed whenever the
+ * level revision changes. As the player light is evaluated while shading, the light
+ * maps do not depend on the camera and are reused between frames and portal visits.
+ * The level lights reaching each sprite are summed up and cached the same way.
+ *
+ * When the coarse shadow resolution is configured, sectors are first baked with that
+ * resolution and coarse shadow depth, which keeps entering new areas quick, and are
+ * later replaced with the full quality light maps one at a time by Lighting::refine.
+ *
+ * Light maps of sectors about to be seen can be baked ahead by Lighting::prefetch. This
+ * happens on a separate thread, working on a copy of the level, and the results are
+ * taken over by Lighting::collectPrefetched unless the level was modified meanwhile.
+ * Refinements are baked the same way. The background bakes have their own thread pool,
+ * so the rendering threads never pick up their work.
+ */
 class Lighting
 {
+    // Light map texels per world unit and how many portals the light is followed through
+    struct Quality
+    {
+        double resolution;
+        int depth;
+    };
+
+    struct SectorLightMaps
+    {
+        OffsetLightMap ceiling, floor;
+        std::vector<LightMap> walls;
+        std::vector<LightPoint> sprites;
+        bool coarse;
+    };
+
+    // Sprite which may block light passing through its sector, with everything needed for the shadow test
+    struct ShadowCaster
+    {
+        double x, y, h;
+        double top, bottom;
+        int texture;
+    };
+
+    using ShadowCasters = std::vector<ShadowCaster>;
+
+    struct PortalWindow
+    {
+        double xStart, yStart, xEnd, yEnd;
+    };
+
+    // Sector with lights, reached by crossing portals[firstPortal, firstPortal + portalCount)
+    struct LightPath
+    {
+        const world::Sector* sector;
+        size_t firstPortal, portalCount;
+    };
+
+    // All sectors whose lights can shine into a sector, with the portals the light has to pass through
+    struct ReachableLights
+    {
+        std::vector<LightPath> paths;
+        std::vector<PortalWindow> portals;
+    };
+
 public:
 
-    using TextureGetter  = std::function<sdl::Surface&(const std::string&)>;
-    using LightAdder     = std::function<void(const world::Light&, const world::Sector&)>;
-    using LightPredicate = std::function<bool()>;
+    using TextureGetter = std::function<sdl::Surface&(int)>;
 
-    Lighting(const world::Level& level, TextureGetter textureGetter);
+    Lighting(const world::Level& level, ThreadPool& pool, TextureGetter textureGetter);
     ~Lighting();
 
-    LightMap prepareWallMap(const world::Sector& sector, const world::Wall& wall, const game::Position& player);
-    std::pair<OffsetLightMap, OffsetLightMap> prepareSurfaceMap(const world::Sector& sector,
-                                                                const game::Position& player);
-    LightPoint calculateWallLighting(double mapX, double mapY, const LightMap& lightMap);
-    LightPoint calculateSurfaceLighting(double mapX, double mapY, const OffsetLightMap& lightMap);
+    const LightMap& prepareWallMap(const world::Sector& sector, const world::Wall& wall);
+    std::pair<const OffsetLightMap&, const OffsetLightMap&> prepareSurfaceMap(const world::Sector& sector);
+    // Fills samples.r, g and b of the first count samples, whose u and v are light map texel coordinates
+    void calculateWallLighting(LightSamples& samples, int count, const LightMap& lightMap);
+    // Same as above, except that u and v are world coordinates on the ceiling or floor
+    void calculateSurfaceLighting(LightSamples& samples, int count, const OffsetLightMap& lightMap);
     LightPoint
     calculateSpriteLighting(const world::Sector& sector, const world::Sprite& sprite, const game::Position& player);
 
+    /**
+     * @brief Starts baking the full quality light maps of a sector with coarse ones in the background.
+     * @param sector Sector to refine.
+     * @return True if the sector has coarse light maps, false if there was nothing to do.
+     *
+     * Nothing is started while another background bake is not collected. The coarse light maps are
+     * replaced by Lighting::collectPrefetched.
+     */
+    bool refine(const world::Sector& sector);
+
+    /**
+     * @brief Returns the light maps revision.
+     * @return Value changing whenever any light map is replaced, either by a level modification or a refinement.
+     */
+    [[nodiscard]] uint64_t revision() const;
+
+    /**
+     * @brief Returns the sectors whose light maps were refined since the last call.
+     */
+    std::vector<int> takeRefinedSectors();
+
+    /**
+     * @brief Starts baking the full quality light maps of the sectors which do not have them yet in the background.
+     * @param sectors Identifiers of the sectors, the ones needed first at the front.
+     *
+     * Does nothing while the previous prefetch is not collected.
+     */
+    void prefetch(std::vector<int> sectors);
+
+    /**
+     * @brief Moves the prefetched or refined light maps to the cache, if the background bake is finished.
+     *
+     * References to the replaced coarse light maps are invalidated.
+     */
+    void collectPrefetched();
+
+    /**
+     * @brief Waits for the prefetch to finish and collects it.
+     *
+     * Has to be called before anything the prefetch reads besides the level, such as textures, is modified.
+     */
+    void finishPrefetch();
+
 private:
 
+    const SectorLightMaps& staticMaps(const world::Sector& sector);
+    void bakeInBackground(std::vector<int> sectors);
+    SectorLightMaps bakeSector(const world::Sector& sector, const Quality& quality);
+    const ShadowCasters& shadowCasters(const world::Sector& sector);
+    const ReachableLights& reachableLights(const world::Sector& sector);
+    void collectLightPaths(ReachableLights& reachable,
+                           std::vector<PortalWindow>& portals,
+                           const world::Sector& origin,
+                           const world::Sector& current,
+                           int caller,
+                           int remainingDepth);
+    LightMap bakeWallMap(const world::Sector& sector,
+                         const world::Wall& wall,
+                         const ShadowCasters& casters,
+                         const ReachableLights& reachable,
+                         const Quality& quality);
+    std::pair<OffsetLightMap, OffsetLightMap> bakeSurfaceMap(const world::Sector& sector,
+                                                             const ShadowCasters& casters,
+                                                             const ReachableLights& reachable,
+                                                             const Quality& quality);
+    LightPoint bakeSpriteLighting(const world::Sector& sector, const world::Sprite& sprite);
+
     void addLight(LightPoint& target,
-                  const world::Sector& sector,
+                  const ShadowCasters& casters,
                   const world::Light& light,
-                  const game::Position& player,
                   double worldX,
                   double worldY,
                   double worldZ);
-    void gatherLights(std::queue<GatheredSector>& gatheringQueue,
+    template<typename LightVisitor, typename LightPredicate>
+    void gatherLights(const ReachableLights& reachable,
+                      int depth,
                       double mapX,
                       double mapY,
-                      const game::Position& player,
-                      const world::Light& playerLight,
-                      const LightAdder& lightAdder,
+                      const LightVisitor& lightVisitor,
                       const LightPredicate& lightPredicate);
 
     const world::Level& level;
+    ThreadPool& pool;
     TextureGetter getTexture;
+    Quality fullQuality;
+    std::optional<Quality> coarseQuality;
+
+    std::unordered_map<int, SectorLightMaps> cache{};
+    std::unordered_map<int, ShadowCasters> casterCache{};
+    std::unordered_map<int, ReachableLights> reachableCache{};
+    std::optional<uint64_t> cacheRevision{};
+    uint64_t refinements{0};
+    std::vector<int> refinedSectors{};
+
+    std::unique_ptr<ThreadPool> prefetchPool{};
+    std::shared_ptr<const world::Level> snapshot{};
+    std::future<std::unordered_map<int, SectorLightMaps>> prefetched{};
+    uint64_t prefetchRevision{};
 };
 } // namespace engine
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "sdlwrapper/common_types.hpp"
+
+#include <vector>
+
+namespace sdl
+{
+class Surface;
+}
+
+namespace engine
+{
+/**
+ * @class MipmappedTexture
+ * @brief Texture laid out for the renderer, with a chain of downscaled levels.
+ *
+ * Walls and sprites are drawn column by column, so the texels are stored column after
+ * column. Both dimensions of the base level are resampled up to the nearest power of two,
+ * which lets the texture coordinates be wrapped with a mask instead of a modulo. Every
+ * following level is half the size of the previous one, down to a single texel.
+ */
+class MipmappedTexture
+{
+public:
+
+    struct Level
+    {
+        int width, height;
+        int widthMask, heightMask;
+        std::vector<sdl::Pixel> pixels;
+
+        /**
+         * @brief Returns the texels of a column, wrapping the coordinate around the level width.
+         */
+        [[nodiscard]] const sdl::Pixel* column(int x) const { return pixels.data() + (x & widthMask) * height; }
+
+        [[nodiscard]] sdl::Pixel texel(int x, int y) const { return column(x)[y & heightMask]; }
+    };
+
+    explicit MipmappedTexture(const sdl::Surface& surface);
+
+    /**
+     * @brief Picks the level to be sampled.
+     * @param texelsPerPixel Number of base level texels covered by a screen pixel.
+     * @return Index of the level whose texels are closest to the size of a pixel, without being smaller.
+     */
+    [[nodiscard]] int levelFor(double texelsPerPixel) const;
+
+    [[nodiscard]] const Level& level(int index) const { return levels[index]; }
+    [[nodiscard]] int levelCount() const { return (int)levels.size(); }
+
+private:
+
+    std::vector<Level> levels;
+};
+} // namespace engine
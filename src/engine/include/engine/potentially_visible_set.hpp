@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace world
+{
+class Level;
+class Sector;
+class Wall;
+} // namespace world
+
+namespace engine
+{
+class ThreadPool;
+
+/**
+ * @class PotentiallyVisibleSet
+ * @brief Sectors and walls which can ever be seen from each sector of the level.
+ *
+ * A wall is potentially visible from a sector when some line leaving the sector crosses
+ * a chain of portals leading to the sector of the wall, and the wall itself. The chains are
+ * checked on the map plane only, the same way the light paths are, so the sets are
+ * conservative: the heights of the sectors never hide anything. Portals with a rotation
+ * do not keep lines of sight straight, so everything behind them is considered visible.
+ *
+ * The sets can be calculated for the whole level when it is loaded, otherwise each one is
+ * calculated on first use. Like the light maps, they are dropped whenever the level
+ * revision changes.
+ */
+class PotentiallyVisibleSet
+{
+    struct PortalWindow
+    {
+        double xStart, yStart, xEnd, yEnd;
+    };
+
+    // Sectors and walls visible from a single sector, indexed the same way as sectorIndices and firstWalls
+    struct VisibleSet
+    {
+        std::vector<bool> sectors, walls;
+    };
+
+public:
+
+    PotentiallyVisibleSet(const world::Level& level, ThreadPool& pool, int depth);
+
+    void precalculate();
+
+    /**
+     * @brief Selects the sector the following queries are made from.
+     *
+     * Not thread-safe, as it may calculate the set of the sector. The queries are read-only
+     * and may be made concurrently.
+     */
+    void lookFrom(int sector);
+
+    [[nodiscard]] bool visible(int sector) const;
+    [[nodiscard]] bool visible(const world::Sector& sector, const world::Wall& wall) const;
+
+private:
+
+    void update();
+    VisibleSet calculate(const world::Sector& origin) const;
+    void collectChains(VisibleSet& set,
+                       std::vector<PortalWindow>& portals,
+                       const world::Sector& current,
+                       int caller,
+                       int remainingDepth,
+                       double offsetX,
+                       double offsetY) const;
+    void collectReachable(VisibleSet& set,
+                          std::vector<int>& reachedDepths,
+                          const world::Sector& current,
+                          int remainingDepth) const;
+
+    const world::Level& level;
+    ThreadPool& pool;
+    int depth;
+
+    std::unordered_map<int, int> sectorIndices{};
+    std::vector<const world::Sector*> sectors{};
+    std::vector<size_t> firstWalls{};
+    size_t wallCount{};
+    std::vector<std::optional<VisibleSet>> sets{};
+    const VisibleSet* current{};
+    std::optional<uint64_t> revision{};
+};
+} // namespace engine
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace engine
+{
+/**
+ * @class ResolutionController
+ * @brief Chooses the render resolution of the next frame, so that rendering fits in a time budget.
+ *
+ * Rendering time grows with the number of pixels, so the scale of both frame dimensions follows
+ * the square root of the ratio between the budget and the measured time. The scale is lowered
+ * as soon as a frame takes too long, but raised only when there is a clear margin, and every
+ * change is damped, so that the resolution does not oscillate between frames.
+ */
+class ResolutionController
+{
+public:
+
+    /**
+     * @param targetTime Rendering time budget in milliseconds, 0 keeps the full resolution.
+     * @param minimumScale Lowest scale of the frame dimensions, relative to the full resolution.
+     */
+    ResolutionController(double targetTime, double minimumScale);
+
+    /**
+     * @brief Adjusts the scale after a frame was rendered.
+     * @param renderTime Time the frame took to render, in nanoseconds.
+     */
+    void update(uint64_t renderTime);
+
+    [[nodiscard]] double scale() const;
+
+private:
+
+    uint64_t targetTime;
+    double minimumScale;
+    double currentScale{1};
+};
+} // namespace engine
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "sdlwrapper/common_types.hpp"
+
+#include <algorithm>
+
+namespace engine
+{
+class LightPoint;
+struct LightSamples;
+
+/**
+ * @brief Scales the color channels of a pixel by the light falling on it.
+ *
+ * Lighting can only darken the texture, so each factor is effectively clamped to [0, 1].
+ */
+constexpr sdl::Pixel shadeRgb(sdl::Pixel pixel, double r, double g, double b)
+{
+    auto pR = (pixel & 0x00'ff'00'00) >> 16;
+    auto pG = (pixel & 0x00'00'ff'00) >> 8;
+    auto pB = (pixel & 0x00'00'00'ff) >> 0;
+    pR      = std::clamp((int)((double)pR * r), 0, (int)pR);
+    pG      = std::clamp((int)((double)pG * g), 0, (int)pG);
+    pB      = std::clamp((int)((double)pB * b), 0, (int)pB);
+    return (pR << 16) | (pG << 8) | (pB << 0);
+}
+
+/**
+ * @brief Adds more light to an already shaded pixel.
+ * @param shaded Pixel shaded with some light.
+ * @param pixel The same pixel before shading.
+ *
+ * The result matches shading the pixel with the sum of both lights, up to rounding.
+ */
+constexpr sdl::Pixel addShading(sdl::Pixel shaded, sdl::Pixel pixel, double r, double g, double b)
+{
+    auto added        = shadeRgb(pixel, r, g, b);
+    sdl::Pixel result = 0;
+    for (auto shift : {16, 8, 0})
+    {
+        auto channel = ((shaded >> shift) & 0xff) + ((added >> shift) & 0xff);
+        result |= std::min(channel, (pixel >> shift) & 0xff) << shift;
+    }
+    return result;
+}
+
+/**
+ * @brief Shades a run of texels, each with its own light.
+ * @param texels Texture pixels to be shaded.
+ * @param light Light at every texel, in samples r, g and b.
+ * @param count Number of texels, at most LightSamples::capacity.
+ * @param target Where the shaded pixels are written.
+ *
+ * Depending on the instruction set the engine is built for, eight (AVX2), four (SSE2)
+ * or one pixel is shaded at a time.
+ */
+void shadePixels(const sdl::Pixel* texels, const LightSamples& light, int count, sdl::Pixel* target);
+
+/**
+ * @brief Shades a run of texels lit the same way.
+ */
+void shadePixels(const sdl::Pixel* texels, const LightPoint& light, int count, sdl::Pixel* target);
+
+/**
+ * @brief Reference implementations of the above, one pixel at a time.
+ */
+void shadePixelsScalar(const sdl::Pixel* texels, const LightSamples& light, int count, sdl::Pixel* target);
+void shadePixelsScalar(const sdl::Pixel* texels, const LightPoint& light, int count, sdl::Pixel* target);
+} // namespace engine
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "sdlwrapper/common_types.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace engine
+{
+/**
+ * @class SurfaceCache
+ * @brief Textures of walls, ceilings and floors with the level lights already applied.
+ *
+ * Shading a pre-lit surface only takes copying its texels, so the light map does not have
+ * to be sampled for every pixel. Surfaces are made separately for each mip level, and the
+ * least recently used ones are dropped once the memory budget is exceeded. All surfaces
+ * are dropped whenever the level revision changes, and the surfaces of a single sector
+ * when its light maps are refined.
+ *
+ * The rendering threads only look the surfaces up. Missing ones are remembered as requests,
+ * which the engine builds before the next frame is drawn, the same way the light maps are
+ * baked, so no rendering thread ever waits for a surface being built by another one.
+ */
+class SurfaceCache
+{
+public:
+
+    constexpr static auto ceiling{-1};
+    constexpr static auto floor{-2};
+
+    // Lit texels of a surface, stored column after column
+    struct LitSurface
+    {
+        int width, height;
+        int originX, originY; // texture texel the first surface texel was made of
+        std::vector<sdl::Pixel> pixels;
+
+        [[nodiscard]] const sdl::Pixel* column(int x) const
+        {
+            return pixels.data() + std::clamp(x, 0, width - 1) * height;
+        }
+
+        [[nodiscard]] sdl::Pixel texel(int x, int y) const
+        {
+            return column(x - originX)[std::clamp(y - originY, 0, height - 1)];
+        }
+    };
+
+    struct Request
+    {
+        int sector, surface, mipLevel;
+    };
+
+    /**
+     * @param budget Memory the surfaces may take, in bytes; zero disables the cache.
+     */
+    explicit SurfaceCache(size_t budget);
+
+    [[nodiscard]] bool enabled() const;
+
+    /**
+     * @brief Checks whether a surface of given dimensions is small enough to be cached.
+     */
+    [[nodiscard]] bool fits(int width, int height) const;
+
+    /**
+     * @brief Drops all the surfaces if the level revision has changed since the last call.
+     */
+    void invalidate(uint64_t revision);
+
+    /**
+     * @brief Drops the surfaces of a sector.
+     */
+    void invalidateSector(int sector);
+
+    /**
+     * @brief Returns a lit surface, or requests it if it is not cached.
+     * @param sector Sector containing the surface.
+     * @param surface Index of the wall, or ceiling or floor.
+     * @param mipLevel Texture mip level the surface is made of.
+     * @return The surface, or nullptr if it is not cached yet.
+     */
+    std::shared_ptr<const LitSurface> find(int sector, int surface, int mipLevel);
+
+    /**
+     * @brief Returns the surfaces requested since the last call, each of them once.
+     */
+    std::vector<Request> takeRequests();
+
+    /**
+     * @brief Stores a built surface.
+     */
+    void put(const Request& request, LitSurface surface);
+
+private:
+
+    struct Entry
+    {
+        std::shared_ptr<const LitSurface> surface{};
+        std::list<uint64_t>::iterator position{};
+        size_t size{0};
+    };
+
+    void evict();
+
+    size_t budget;
+    size_t used{0};
+    std::optional<uint64_t> revision{};
+
+    std::mutex mutex{};
+    std::unordered_map<uint64_t, Entry> entries{};
+    std::list<uint64_t> recentlyUsed{};
+    std::vector<Request> requests{};
+    std::unordered_set<uint64_t> requested{};
+};
+} // namespace engine
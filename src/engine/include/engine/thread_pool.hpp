@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace engine
+{
+/**
+ * @brief Persistent worker threads running the parallel loops of the engine.
+ *
+ * Every worker owns a deque of jobs. It takes jobs from the back of its own deque and,
+ * once that runs dry, steals from the front of the other ones. The thread calling
+ * parallelFor keeps executing jobs until its loop is finished, so loops may be nested.
+ * When built with DISABLE_PARALLELISM no workers are started and the loops run inline.
+ */
+class ThreadPool
+{
+public:
+
+    /**
+     * @param threads total number of threads working on a loop, including the calling one;
+     *                zero or less picks the number of hardware threads
+     */
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Calls body(i) for every i in [begin, end), split into jobs of grain iterations.
+     * Returns once all iterations are done.
+     */
+    template<typename Body>
+    void parallelFor(int begin, int end, int grain, const Body& body)
+    {
+        grain = std::max(grain, 1);
+        if (workers.empty() or end - begin <= grain)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                body(i);
+            }
+            return;
+        }
+
+        run(begin,
+            end,
+            grain,
+            &body,
+            [](const void* context, int first, int last)
+            {
+                const auto& body = *static_cast<const Body*>(context);
+                for (int i = first; i < last; ++i)
+                {
+                    body(i);
+                }
+            });
+    }
+
+    [[nodiscard]] int size() const;
+
+private:
+
+    using Invoker = void (*)(const void*, int, int);
+
+    struct Batch
+    {
+        const void* context;
+        Invoker invoke;
+        std::atomic<int> remaining;
+    };
+
+    struct Job
+    {
+        Batch* batch;
+        int begin, end;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex{};
+        std::deque<Job> jobs{};
+        std::thread thread{};
+    };
+
+    void run(int begin, int end, int grain, const void* context, Invoker invoke);
+    bool runOne(int self);
+    bool pop(int self, Job& job);
+    bool steal(int self, Job& job);
+    void workerLoop(int self);
+
+    std::vector<std::unique_ptr<Worker>> workers{};
+    std::atomic<int> queued{0};
+    std::atomic<unsigned> nextWorker{0};
+    std::mutex sleepMutex{};
+    std::condition_variable wakeUp{};
+    bool stopping{false};
+};
+} // namespace engine
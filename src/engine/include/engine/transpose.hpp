@@ -0,0 +1,18 @@
+#pragma once
+
+#include "sdlwrapper/common_types.hpp"
+
+namespace engine
+{
+/**
+ * @brief Copies a column-major image into a row-major one.
+ * @param columns Source image, stored column after column.
+ * @param rows Target image, stored row after row.
+ * @param width Width of both images.
+ * @param height Height of both images.
+ *
+ * The image is moved in square blocks transposed in registers, eight pixels wide with
+ * AVX2 and four with SSE2. Pixels not covered by whole blocks are copied one by one.
+ */
+void transposeColumns(const sdl::Pixel* columns, sdl::Pixel* rows, int width, int height);
+} // namespace engine
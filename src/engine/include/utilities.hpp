@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <utility>
+#include <vector>
 
 namespace engine
 {
@@ -16,4 +18,49 @@ constexpr auto intersect(double x1, double y1, double x2, double y2, double x3,
     auto m  = cross(x1 - x2, y1 - y2, x3 - x4, y3 - y4);
     return std::make_pair(cross(c1, x1 - x2, c2, x3 - x4) / m, cross(c1, y1 - y2, c2, y3 - y4) / m);
 }
+
+// Checks whether some line crosses all the portals, entering each of them from the same side. The portals are
+// segments from (xStart, yStart) to (xEnd, yEnd), oriented the way sector walls are.
+bool stabbable(const auto& portals)
+{
+    constexpr static auto epsilon = 1e-9;
+
+    using Point = std::pair<double, double>;
+
+    auto side = [](Point origin, Point direction, double x, double y)
+    { return cross(x - origin.first, y - origin.second, direction.first, direction.second); };
+
+    auto separates = [&](Point origin, Point direction)
+    {
+        return std::ranges::all_of(portals,
+                                   [&](const auto& portal)
+                                   {
+                                       return side(origin, direction, portal.xStart, portal.yStart) <= epsilon and
+                                              side(origin, direction, portal.xEnd, portal.yEnd) >= -epsilon;
+                                   });
+    };
+
+    // If any such line exists, one of them passes through two of the portal ends
+    std::vector<Point> ends{};
+    ends.reserve(2 * portals.size());
+    for (const auto& portal : portals)
+    {
+        ends.emplace_back(portal.xStart, portal.yStart);
+        ends.emplace_back(portal.xEnd, portal.yEnd);
+    }
+
+    for (const auto& origin : ends)
+    {
+        for (const auto& other : ends)
+        {
+            Point direction{other.first - origin.first, other.second - origin.second};
+            if ((direction.first != 0 or direction.second != 0) and separates(origin, direction))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
 } // namespace engine
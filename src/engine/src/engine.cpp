@@ -3,43 +3,61 @@
 #include "game/player.hpp"
 #include "sdlwrapper/renderer.hpp"
 #include "sdlwrapper/sdlwrapper.hpp"
+#include "shading.hpp"
+#include "transpose.hpp"
 #include "utilities.hpp"
 #include "world/level.hpp"
 
 #include <algorithm>
 #include <cmath>
-
-#if not defined(DISABLE_PARALLELISM)
-    #include <boost/iterator/counting_iterator.hpp>
-    #ifdef __APPLE__
-        #include <oneapi/dpl/algorithm>
-        #include <oneapi/dpl/execution>
-    #else
-        #include <execution>
-    #endif
-#endif
+#include <tuple>
 
 namespace engine
 {
 namespace
 {
-constexpr auto loadingMargin  = 32;
-constexpr auto loadingBarSize = 4;
+constexpr auto loadingMargin   = 32;
+constexpr auto loadingBarSize  = 4;
+constexpr auto columnsGrain    = 16;
+constexpr auto spansGrain      = 8;
+constexpr auto fixedPointShift = 16;
+constexpr auto portalDepth     = 32;
+
+// How quickly the weight of a lighting sample drops with its relative depth difference from the upsampled pixel
+constexpr auto lightingDepthSensitivity = 16.0;
+
+// Checks whether the light is strong enough to change any color channel
+constexpr auto isNoticeable(const LightPoint& light)
+{
+    return std::max({light.r, light.g, light.b}) * 255 >= 1;
+}
 
-constexpr auto shadeRgb(uint32_t pixel, double r, double g, double b)
+// All pixels of a plane row are at the same depth, so a single mip level fits the whole row
+int planeMipLevel(const MipmappedTexture& texture, const game::Position& player, double planeY, int rowsFromHorizon)
 {
-    auto pR = (pixel & 0x00'ff'00'00) >> 16;
-    auto pG = (pixel & 0x00'00'ff'00) >> 8;
-    auto pB = (pixel & 0x00'00'00'ff) >> 0;
-    pR      = std::clamp((int)((double)pR * r), 0, (int)pR);
-    pG      = std::clamp((int)((double)pG * g), 0, (int)pG);
-    pB      = std::clamp((int)((double)pB * b), 0, (int)pB);
-    return (pR << 16) | (pG << 8) | (pB << 0);
+    auto transformedZ = planeY * player.fovV / rowsFromHorizon;
+    return texture.levelFor(std::abs(transformedZ / player.fovH) * texture.level(0).width);
 }
 
-constexpr auto shadeRgb(uint32_t pixel, const LightPoint& color)
+// A lit wall repeats the texture along its whole length and height, without any pixels yet
+SurfaceCache::LitSurface wallLayout(const world::Sector& sector,
+                                    const world::Wall& wall,
+                                    const MipmappedTexture::Level& mip)
 {
-    return shadeRgb(pixel, color.r, color.g, color.b);
+    auto repeats = std::max((int)(std::hypot(wall.xEnd - wall.xStart, wall.yEnd - wall.yStart) *
+                                  (sector.ceiling - sector.floor)),
+                            1);
+    return SurfaceCache::LitSurface{mip.width * repeats, mip.height, 0, 0, {}};
+}
+
+// A lit ceiling or floor covers the texels within the sector bounds, without any pixels yet
+SurfaceCache::LitSurface planeLayout(const world::Sector& sector, const MipmappedTexture::Level& mip)
+{
+    auto originX = (int)std::floor(sector.boundsLeft * mip.width);
+    auto originY = (int)std::floor(sector.boundsTop * mip.height);
+    auto width   = (int)std::ceil(sector.boundsRight * mip.width) - originX + 1;
+    auto height  = (int)std::ceil(sector.boundsBottom * mip.height) - originY + 1;
+    return SurfaceCache::LitSurface{width, height, originX, originY, {}};
 }
 
 void loadingScreen(sdl::Renderer& renderer, int progress, int max)
@@ -66,113 +84,366 @@ Engine::Engine(sdl::Renderer& renderer, world::Level& level)
     : renderer(renderer)
     , view(renderer.createTexture(sdl::Texture::Access::Streaming, c::renderWidth, c::renderHeight))
     , level(level)
-    , lighting(level, [&](const std::string& texture) -> sdl::Surface& { return getTexture(texture); })
+    , pool(c::workerThreads)
+    , lighting(level, pool, [&](int texture) -> sdl::Surface& { return getTexture(texture); })
+    , visibility(level, pool, portalDepth)
+    , surfaceCache((size_t)c::surfaceCacheSize << 20)
+    , deferLighting(c::deferredLighting or c::lightingScale > 1)
+    , resolution(c::targetFrameTime, c::minimumRenderScale)
 {
+    auto pixels = (size_t)(c::renderWidth * c::renderHeight);
+    limitTop.resize(c::renderWidth);
+    limitBottom.resize(c::renderWidth);
+    for (auto* columns : {&coverage, &ceilingColumns, &floorColumns})
+    {
+        columns->top.resize(c::renderWidth);
+        columns->bottom.resize(c::renderWidth);
+    }
+    buffer.resize(pixels);
+    zBuffer.resize(pixels);
+    frameBuffer.resize(pixels);
+    if (deferLighting)
+    {
+        geometryBuffer.source.resize(pixels);
+        geometryBuffer.u.resize(pixels);
+        geometryBuffer.v.resize(pixels);
+        geometryBuffer.playerDistance.resize(pixels);
+    }
+
     SPDLOG_INFO("Initialized engine");
 }
 
 void Engine::preload()
 {
     loadingScreen(renderer, 0, 1);
-    std::unordered_set<std::string> filenames;
-    for (const auto& [_, sector] : level.sectors())
+    updateTextures(true);
+    visibility.precalculate();
+}
+
+void Engine::updateTextures(bool showProgress)
+{
+    const auto& names = level.textureNames();
+
+    if (texturesRevision != level.revision())
     {
-        filenames.emplace(sector.ceilingTexture);
-        filenames.emplace(sector.floorTexture);
-        std::transform(sector.walls.begin(),
-                       sector.walls.end(),
-                       std::inserter(filenames, filenames.begin()),
-                       [](const auto& wall) { return wall.texture; });
-        for (const auto& sprite : sector.sprites)
-        {
-            std::transform(sprite.textures.begin(),
-                           sprite.textures.end(),
-                           std::inserter(filenames, filenames.begin()),
-                           [](const auto& texture) { return texture.texture; });
-        }
+        level.resolveTextures();
+        texturesRevision = level.revision();
     }
-    std::copy(level.additionalTextures.begin(),
-              level.additionalTextures.end(),
-              std::inserter(filenames, filenames.end()));
-    int i = 0;
-    for (const auto& filename : filenames)
+
+    // Light maps prefetched in the background read the textures of the shadow casters
+    if (textures.size() < names.size())
     {
-        loadingScreen(renderer, ++i, filenames.size());
-        getTexture(filename);
+        lighting.finishPrefetch();
     }
-}
 
-sdl::Surface& Engine::getTexture(const std::string& name)
-{
-    if (not textures.contains(name))
+    textures.reserve(names.size());
+    mipmaps.reserve(names.size());
+    while (textures.size() < names.size())
     {
+        const auto& name = names[textures.size()];
+        if (showProgress)
+        {
+            loadingScreen(renderer, (int)textures.size() + 1, (int)names.size());
+        }
         SPDLOG_DEBUG("Loading texture {}", name);
-        textures.emplace(name, std::format("res/gfx/{}.png", name));
+        textures.emplace_back(std::format("res/gfx/{}.png", name));
+        mipmaps.emplace_back(textures.back());
     }
+}
 
-    return textures.at(name);
+sdl::Surface& Engine::getTexture(int handle)
+{
+    return textures[handle];
 }
 
-void Engine::frame(const game::Position& player)
+const MipmappedTexture& Engine::getMipmaps(int handle)
 {
-    constexpr static auto renderStart  = 0;
-    constexpr static auto renderEnd    = c::renderWidth - 1;
-    constexpr static auto initialDepth = 32;
+    return mipmaps[handle];
+}
 
+void Engine::frame(const game::Position& position)
+{
+    updateTextures(false);
+    lighting.collectPrefetched();
+    for (auto sector : lighting.takeRefinedSectors())
+    {
+        surfaceCache.invalidateSector(sector);
+    }
+
+    // The field of view is given in pixels of the full resolution, so it shrinks together with the rendered frame
+    frameWidth  = std::max((int)std::lround(c::renderWidth * resolution.scale()), 1);
+    frameHeight = std::max((int)std::lround(c::renderHeight * resolution.scale()), 1);
+    auto player = position;
+    player.fovH *= (double)frameWidth / c::renderWidth;
+    player.fovV *= (double)frameHeight / c::renderHeight;
+
+    // While the player stands still and the level is not modified, the previous frame is shown again as it was
+    auto fingerprint = FrameFingerprint{position.sector,
+                                        position.x,
+                                        position.y,
+                                        position.z,
+                                        position.angle,
+                                        position.fovH,
+                                        position.fovV,
+                                        lighting.revision(),
+                                        frameWidth,
+                                        frameHeight};
+
+    // Standing still is also the time to refine the coarse light maps, the frame is rendered again once they are baked
+    if (fingerprint == lastFrame)
+    {
+        refineLighting();
+    }
+
+    frameRendered = fingerprint != lastFrame;
+    if (not frameRendered)
+    {
+        return;
+    }
+    lastFrame = fingerprint;
+
+    // Skipped frames keep reporting the statistics of the frame they show
     lightingTime = 0;
     geometryTime = 0;
     spritesTime  = 0;
 
-    buffer.fill(0);
-    zBuffer.fill(100);
+    surfaceCache.invalidate(level.revision());
+
+    std::fill_n(buffer.begin(), frameWidth * frameHeight, 0);
+    std::fill_n(zBuffer.begin(), frameWidth * frameHeight, 100);
+
+    std::fill_n(limitTop.begin(), frameWidth, 0);
+    std::fill_n(limitBottom.begin(), frameWidth, frameHeight - 1);
+
+    uint64_t frameStart = sdl::currentTimeNs();
+    resolveVisibility(player);
+    lightingTime = sdl::currentTimeNs() - frameStart;
+
+    strips.resize(std::clamp(c::renderStrips, 1, frameWidth));
+    auto stripCount = (int)strips.size();
+    pool.parallelFor(0,
+                     stripCount,
+                     1,
+                     [&](int i)
+                     {
+                         renderStrip(strips[i],
+                                     player,
+                                     frameWidth * i / stripCount,
+                                     frameWidth * (i + 1) / stripCount - 1);
+                     });
+
+    for (const auto& strip : strips)
+    {
+        geometryTime = std::max(geometryTime, strip.geometryTime);
+        spritesTime  = std::max(spritesTime, strip.spritesTime);
+    }
+
+    resolution.update(lightingTime + geometryTime + spritesTime);
+}
+
+void Engine::prefetch(const game::Position& destination)
+{
+    // The visible set of the destination is calculated here if it is missing, the light maps are baked in the
+    // background, starting with the sector the player is heading to
+    visibility.lookFrom(destination.sector);
+
+    std::vector<int> sectors{destination.sector};
+    for (const auto& [id, sector] : level.sectors())
+    {
+        if (id != destination.sector and visibility.visible(id))
+        {
+            sectors.push_back(id);
+        }
+    }
+
+    lighting.prefetch(std::move(sectors));
+}
+
+void Engine::refineLighting()
+{
+    // One sector at a time is baked in the background, the sectors nearer to the camera are queued earlier
+    for (const auto& renderParameters : visibleSectors)
+    {
+        if (lighting.refine(level.sector(renderParameters.id)))
+        {
+            return;
+        }
+    }
+}
+
+void Engine::resolveVisibility(const game::Position& player)
+{
+    constexpr static auto renderStart = 0;
+    auto renderEnd                    = frameWidth - 1;
+
+    visibleSectors.clear();
+    visibility.lookFrom(player.sector);
+    renderQueue.push(SectorRenderParams{player.sector, renderStart, renderEnd, portalDepth});
 
-    limitTop.fill(0);
-    limitBottom.fill(c::renderHeight - 1);
+    std::fill_n(coverage.top.begin(), frameWidth, 0);
+    std::fill_n(coverage.bottom.begin(), frameWidth, frameHeight - 1);
 
-    renderQueue.push(SectorRenderParams{player.sector, renderStart, renderEnd, initialDepth});
+    // Lit surfaces the previous frame was missing are built here, the strips only ever look them up
+    buildLitSurfaces();
 
     while (not renderQueue.empty())
     {
-        auto id = renderQueue.front().id;
+        const auto& renderParameters = renderQueue.front();
+        const world::Sector& sector  = level.sector(renderParameters.id);
 
-        auto renderedAngle = player.angle - renderQueue.front().offsetAngle;
+        // Light maps are baked here, so the strips rendered in parallel only ever read the cache
+        lighting.prepareSurfaceMap(sector);
+        visibleSectors.push_back(renderParameters);
+
+        auto renderedAngle = player.angle - renderParameters.offsetAngle;
         auto angleSin      = std::sin(renderedAngle);
         auto angleCos      = std::cos(renderedAngle);
 
-        const world::Sector& sector = level.sector(id);
+        for (const auto& wall : sector.walls)
+        {
+            if (not wall.portal.has_value() or not visibility.visible(sector, wall))
+            {
+                continue;
+            }
+
+            auto projection = projectWall(renderParameters, wall, player, angleSin, angleCos);
+            if (not projection.has_value())
+            {
+                continue;
+            }
+
+            // Sectors are drawn in the order they are queued, so the coverage follows the limits the portals will set
+            // when drawn, and the neighbour only needs to be drawn where some of its rows are still open
+            auto rows      = projectRows(renderParameters, sector, wall, player, *projection);
+            auto openLeft  = frameWidth;
+            auto openRight = -1;
+            for (int x = projection->beginX; x <= projection->endX; ++x)
+            {
+                std::tie(coverage.top[x], coverage.bottom[x]) =
+                    portalOpening(rows, x, coverage.top[x], coverage.bottom[x]);
+                if (coverage.top[x] < coverage.bottom[x])
+                {
+                    openLeft  = std::min(openLeft, x);
+                    openRight = x;
+                }
+            }
+
+            if (renderParameters.depth <= 0 or openLeft > openRight)
+            {
+                continue;
+            }
+
+            auto newOffsetX     = renderParameters.offsetX;
+            auto newOffsetY     = renderParameters.offsetY;
+            auto newOffsetZ     = renderParameters.offsetZ;
+            auto newOffsetAngle = renderParameters.offsetAngle;
+
+            if (wall.portal->transform.has_value())
+            {
+                const auto& transform = *wall.portal->transform;
+                newOffsetX += transform.x;
+                newOffsetY += transform.y;
+                newOffsetZ += transform.z;
+                newOffsetAngle += transform.angle;
+            }
+
+            renderQueue.push(SectorRenderParams{wall.portal->sector,
+                                                openLeft,
+                                                openRight,
+                                                renderParameters.depth - 1,
+                                                newOffsetX,
+                                                newOffsetY,
+                                                newOffsetZ,
+                                                newOffsetAngle});
+        }
+
+        renderQueue.pop();
+    }
+}
+
+void Engine::renderStrip(RenderStrip& strip, const game::Position& player, int leftX, int rightX)
+{
+    strip.geometryTime = 0;
+    strip.spritesTime  = 0;
+    strip.spanStart.resize(frameHeight);
+    strip.lightSources.clear();
+
+    if (deferLighting)
+    {
+        std::fill(geometryBuffer.source.begin() + pixelIndex(leftX, 0),
+                  geometryBuffer.source.begin() + pixelIndex(rightX + 1, 0),
+                  -1);
+    }
+
+    for (auto renderParameters : visibleSectors)
+    {
+        renderParameters.leftXBoundary  = std::max(renderParameters.leftXBoundary, leftX);
+        renderParameters.rightXBoundary = std::min(renderParameters.rightXBoundary, rightX);
+        if (renderParameters.leftXBoundary > renderParameters.rightXBoundary)
+        {
+            continue;
+        }
+
+        auto renderedAngle = player.angle - renderParameters.offsetAngle;
+        auto angleSin      = std::sin(renderedAngle);
+        auto angleCos      = std::cos(renderedAngle);
+
+        const world::Sector& sector = level.sector(renderParameters.id);
 
         uint64_t sectorStart = sdl::currentTimeNs();
 
-        auto [ceilingLightMap, floorLightMap] = lighting.prepareSurfaceMap(sector, player);
-        uint64_t lightingDone                 = sdl::currentTimeNs();
+        auto [ceilingLightMap, floorLightMap] = lighting.prepareSurfaceMap(sector);
 
+        clearPlanes(renderParameters);
         for (const auto& wall : sector.walls)
         {
-            renderWall(sector, wall, player, angleSin, angleCos, ceilingLightMap, floorLightMap);
+            renderWall(strip, renderParameters, sector, wall, player, angleSin, angleCos);
         }
+
+        auto planeOffsetZ = player.z + renderParameters.offsetZ;
+        renderPlane(strip,
+                    renderParameters,
+                    player,
+                    ceilingColumns,
+                    SurfaceCache::ceiling,
+                    sector.ceiling - planeOffsetZ,
+                    angleSin,
+                    angleCos,
+                    getMipmaps(sector.ceilingTextureHandle),
+                    ceilingLightMap);
+        renderPlane(strip,
+                    renderParameters,
+                    player,
+                    floorColumns,
+                    SurfaceCache::floor,
+                    sector.floor - planeOffsetZ,
+                    angleSin,
+                    angleCos,
+                    getMipmaps(sector.floorTextureHandle),
+                    floorLightMap);
         uint64_t wallsDone = sdl::currentTimeNs();
 
-        renderSprites(sector, player, angleSin, angleCos);
+        renderSprites(strip, renderParameters, sector, player, angleSin, angleCos);
         uint64_t spritesDone = sdl::currentTimeNs();
 
-        renderQueue.pop();
+        strip.geometryTime += wallsDone - sectorStart;
+        strip.spritesTime += spritesDone - wallsDone;
+    }
 
-        lightingTime += lightingDone - sectorStart;
-        geometryTime += wallsDone - lightingDone;
-        spritesTime += spritesDone - wallsDone;
+    if (deferLighting)
+    {
+        uint64_t lightingStart = sdl::currentTimeNs();
+        lightDeferred(strip, leftX, rightX);
+        strip.geometryTime += sdl::currentTimeNs() - lightingStart;
     }
 }
 
-void Engine::renderWall(const world::Sector& sector,
-                        const world::Wall& wall,
-                        const game::Position& player,
-                        double angleSin,
-                        double angleCos,
-                        const OffsetLightMap& ceilingLightMap,
-                        const OffsetLightMap& floorLightMap)
+std::optional<Engine::WallProjection> Engine::projectWall(const SectorRenderParams& renderParameters,
+                                                          const world::Wall& wall,
+                                                          const game::Position& player,
+                                                          double angleSin,
+                                                          double angleCos)
 {
-    const auto& renderParameters = renderQueue.front();
-
     auto wallStartX = wall.xStart - player.x - renderParameters.offsetX;
     auto wallStartY = wall.yStart - player.y - renderParameters.offsetY;
     auto wallEndX   = wall.xEnd - player.x - renderParameters.offsetX;
@@ -188,7 +459,7 @@ void Engine::renderWall(const world::Sector& sector,
 
     if (transformedLeftZ <= 0 and transformedRightZ <= 0)
     {
-        return;
+        return std::nullopt;
     }
 
     if (transformedLeftZ <= 0 or transformedRightZ <= 0)
@@ -244,18 +515,49 @@ void Engine::renderWall(const world::Sector& sector,
     }
 
     double scaleX1 = player.fovH / transformedLeftZ;
-    double scaleY1 = player.fovV / transformedLeftZ;
     double scaleX2 = player.fovH / transformedRightZ;
-    double scaleY2 = player.fovV / transformedRightZ;
 
-    int leftX  = c::renderWidth / 2 - (int)(transformedLeftX * scaleX1);
-    int rightX = c::renderWidth / 2 - (int)(transformedRightX * scaleX2);
+    int leftX  = frameWidth / 2 - (int)(transformedLeftX * scaleX1);
+    int rightX = frameWidth / 2 - (int)(transformedRightX * scaleX2);
 
     if (leftX >= rightX or rightX < renderParameters.leftXBoundary or leftX > renderParameters.rightXBoundary)
     {
-        return;
+        return std::nullopt;
+    }
+
+    int beginX = std::max(leftX, renderParameters.leftXBoundary);
+    int endX   = std::min(rightX, renderParameters.rightXBoundary);
+
+    if (beginX > endX)
+    {
+        return std::nullopt;
     }
 
+    return WallProjection{wallStartX,
+                          wallStartY,
+                          wallEndX,
+                          wallEndY,
+                          transformedLeftX,
+                          transformedLeftZ,
+                          transformedRightX,
+                          transformedRightZ,
+                          boundaryLeft,
+                          boundaryRight,
+                          leftX,
+                          rightX,
+                          beginX,
+                          endX};
+}
+
+Engine::WallRows Engine::projectRows(const SectorRenderParams& renderParameters,
+                                     const world::Sector& sector,
+                                     const world::Wall& wall,
+                                     const game::Position& player,
+                                     const WallProjection& projection)
+{
+    double scaleY1 = player.fovV / projection.transformedLeftZ;
+    double scaleY2 = player.fovV / projection.transformedRightZ;
+
     double ceilingY = sector.ceiling - player.z - renderParameters.offsetZ;
     double floorY   = sector.floor - player.z - renderParameters.offsetZ;
 
@@ -274,171 +576,196 @@ void Engine::renderWall(const world::Sector& sector,
         }
     }
 
-    int leftYTop     = c::renderHeight / 2 - (int)(ceilingY * scaleY1);
-    int leftYBottom  = c::renderHeight / 2 - (int)(floorY * scaleY1);
-    int rightYTop    = c::renderHeight / 2 - (int)(ceilingY * scaleY2);
-    int rightYBottom = c::renderHeight / 2 - (int)(floorY * scaleY2);
+    return WallRows{projection.leftX,
+                    projection.rightX,
+                    frameHeight / 2 - (int)(ceilingY * scaleY1),
+                    frameHeight / 2 - (int)(floorY * scaleY1),
+                    frameHeight / 2 - (int)(ceilingY * scaleY2),
+                    frameHeight / 2 - (int)(floorY * scaleY2),
+                    frameHeight / 2 - (int)(neighbourCeilingY * scaleY1),
+                    frameHeight / 2 - (int)(neighbourFloorY * scaleY1),
+                    frameHeight / 2 - (int)(neighbourCeilingY * scaleY2),
+                    frameHeight / 2 - (int)(neighbourFloorY * scaleY2)};
+}
 
-    int neighbourLeftYTop     = c::renderHeight / 2 - (int)(neighbourCeilingY * scaleY1);
-    int neighbourLeftYBottom  = c::renderHeight / 2 - (int)(neighbourFloorY * scaleY1);
-    int neighbourRightYTop    = c::renderHeight / 2 - (int)(neighbourCeilingY * scaleY2);
-    int neighbourRightYBottom = c::renderHeight / 2 - (int)(neighbourFloorY * scaleY2);
+std::pair<int, int> Engine::portalOpening(const WallRows& rows, int x, int top, int bottom) const
+{
+    auto visibleWallTop    = std::clamp(rows.top(x), top, bottom);
+    auto visibleWallBottom = std::clamp(rows.bottom(x), top, bottom);
+    auto neighbourTop      = std::clamp(rows.neighbourTop(x), top, bottom);
+    auto neighbourBottom   = std::clamp(rows.neighbourBottom(x), top, bottom);
 
-    int beginX = std::max(leftX, renderParameters.leftXBoundary);
-    int endX   = std::min(rightX, renderParameters.rightXBoundary);
+    return {std::clamp(std::max(visibleWallTop, neighbourTop), top, frameHeight - 1),
+            std::clamp(std::min(visibleWallBottom, neighbourBottom), 0, bottom)};
+}
 
-    if (beginX > endX)
+void Engine::renderWall(RenderStrip& strip,
+                        const SectorRenderParams& renderParameters,
+                        const world::Sector& sector,
+                        const world::Wall& wall,
+                        const game::Position& player,
+                        double angleSin,
+                        double angleCos)
+{
+    if (not visibility.visible(sector, wall))
     {
         return;
     }
 
+    auto projection = projectWall(renderParameters, wall, player, angleSin, angleCos);
+    if (not projection.has_value())
+    {
+        return;
+    }
+
+    const auto& [wallStartX,
+                 wallStartY,
+                 wallEndX,
+                 wallEndY,
+                 transformedLeftX,
+                 transformedLeftZ,
+                 transformedRightX,
+                 transformedRightZ,
+                 boundaryLeft,
+                 boundaryRight,
+                 leftX,
+                 rightX,
+                 beginX,
+                 endX] = *projection;
+
+    double ceilingY = sector.ceiling - player.z - renderParameters.offsetZ;
+    double floorY   = sector.floor - player.z - renderParameters.offsetZ;
+
+    auto rows = projectRows(renderParameters, sector, wall, player, *projection);
+
     auto wallLength = std::hypot(wallStartX - wallEndX, wallStartY - wallEndY);
 
     auto distanceLeft  = std::hypot(transformedLeftX, transformedLeftZ, ceilingY - floorY);
     auto distanceRight = std::hypot(transformedRightX, transformedRightZ, ceilingY - floorY);
 
-    auto& t                  = getTexture(wall.texture);
-    int textureBoundaryLeft  = (int)((t.width - 1) * boundaryLeft);
-    int textureBoundaryRight = (int)((t.width - 1) * boundaryRight);
+    const auto& t            = getMipmaps(wall.textureHandle);
+    int textureBoundaryLeft  = (int)((t.level(0).width - 1) * boundaryLeft);
+    int textureBoundaryRight = (int)((t.level(0).width - 1) * boundaryRight);
 
     textureBoundaryRight *= (int)(wallLength * (sector.ceiling - sector.floor));
 
-    auto lightPoints        = lighting.prepareWallMap(sector, wall, player);
+    // Base level texture column seen at a screen column; its change between adjacent columns is how many texels a
+    // pixel covers horizontally, which grows as the wall is seen at a grazing angle
+    auto textureColumn = [&](double x)
+    {
+        return (textureBoundaryLeft * ((rightX - x) * transformedRightZ) +
+                textureBoundaryRight * ((x - leftX) * transformedLeftZ)) /
+               ((rightX - x) * transformedRightZ + (x - leftX) * transformedLeftZ);
+    };
+    auto texelsPerColumn = [&](int x)
+    {
+        // Measured within the wall, where the perspective division is well defined
+        auto first = std::clamp(x - 0.5, (double)leftX, rightX - 1.0);
+        return std::abs(textureColumn(first + 1) - textureColumn(first));
+    };
+
+    const auto& lightPoints = lighting.prepareWallMap(sector, wall);
     int lightsBoundaryLeft  = (int)((lightPoints.width - 2) * boundaryLeft);
     int lightsBoundaryRight = (int)((lightPoints.width - 2) * boundaryRight);
+    auto lightSource        = addLightSource(strip, LightSource{&lightPoints, nullptr, {}, playerWallLight});
 
-#if defined(DISABLE_PARALLELISM)
-    for (int x = beginX; x <= endX; ++x)
-#else
-    std::for_each(
-        std::execution::par,
-        boost::counting_iterator(beginX),
-        boost::counting_iterator(endX + 1),
-        [&](int x)
-#endif
+    // A pre-lit surface is made of a single mip level, fine enough for the nearer end of the wall
+    std::shared_ptr<const SurfaceCache::LitSurface> litSurface{};
+    int litMipLevel = 0;
+    if (surfaceCache.enabled() and not deferLighting)
+    {
+        auto leftTexels  = std::max(t.level(0).height / (double)(rows.leftBottom - rows.leftTop + 1),
+                                   texelsPerColumn(leftX));
+        auto rightTexels = std::max(t.level(0).height / (double)(rows.rightBottom - rows.rightTop + 1),
+                                    texelsPerColumn(rightX));
+        litMipLevel      = t.levelFor(std::min(leftTexels, rightTexels));
+        litSurface       = litWall(sector, wall, t, litMipLevel);
+    }
+
+    auto renderColumn = [&](int x)
     {
         auto distance = (distanceRight - distanceLeft) * (x - leftX) / (rightX - leftX) + distanceLeft;
 
-        auto wallTop           = (x - leftX) * (rightYTop - leftYTop) / (rightX - leftX) + leftYTop;
-        auto wallBottom        = (x - leftX) * (rightYBottom - leftYBottom) / (rightX - leftX) + leftYBottom;
+        auto wallTop           = rows.top(x);
+        auto wallBottom        = rows.bottom(x);
         auto visibleWallTop    = std::clamp(wallTop, limitTop[x], limitBottom[x]);
         auto visibleWallBottom = std::clamp(wallBottom, limitTop[x], limitBottom[x]);
 
-        renderCeilingAndFloor(sector,
-                              player,
-                              x,
-                              visibleWallTop,
-                              visibleWallBottom,
-                              ceilingY,
-                              floorY,
-                              angleSin,
-                              angleCos,
-                              ceilingLightMap,
-                              floorLightMap);
+        ceilingColumns.top[x]    = limitTop[x];
+        ceilingColumns.bottom[x] = visibleWallTop - 1;
+        floorColumns.top[x]      = visibleWallBottom + 1;
+        floorColumns.bottom[x]   = limitBottom[x];
 
         double denominator = 1.0 / ((rightX - x) * transformedRightZ + (x - leftX) * transformedLeftZ);
         auto xProgress     = (((double)lightsBoundaryLeft * (rightX - x) * transformedRightZ) +
                           (double)lightsBoundaryRight * (x - leftX) * transformedLeftZ) *
                          denominator;
-        int textureX = (int)((textureBoundaryLeft * ((rightX - x) * transformedRightZ) +
-                              textureBoundaryRight * ((x - leftX) * transformedLeftZ)) *
-                             denominator);
-        while (textureX < 0)
-        {
-            textureX += t.width;
-        }
-
-        if (wall.portal.has_value())
-        {
-            int neighbourTop = std::clamp((x - leftX) * (neighbourRightYTop - neighbourLeftYTop) / (rightX - leftX) +
-                                              neighbourLeftYTop,
-                                          limitTop[x],
-                                          limitBottom[x]);
+        int textureX = (int)textureColumn(x);
 
-            int neighbourBottom = std::clamp(
-                (x - leftX) * (neighbourRightYBottom - neighbourLeftYBottom) / (rightX - leftX) + neighbourLeftYBottom,
-                limitTop[x],
-                limitBottom[x]);
+        auto wallProgress = (boundaryLeft * (rightX - x) * transformedRightZ +
+                             boundaryRight * (x - leftX) * transformedLeftZ) *
+                            denominator;
+        auto playerDistanceX  = wallStartX + (wallEndX - wallStartX) * wallProgress;
+        auto playerDistanceY  = wallStartY + (wallEndY - wallStartY) * wallProgress;
+        auto playerDistanceXY = playerDistanceX * playerDistanceX + playerDistanceY * playerDistanceY;
 
-            lightedLine(x,
-                        xProgress,
+        auto drawLine = [&](int top, int bottom)
+        {
+            if (litSurface)
+            {
+                litLine(x,
+                        wallProgress,
                         wallTop,
                         wallBottom,
-                        visibleWallTop,
-                        neighbourTop - 1,
-                        t,
-                        textureX,
+                        top,
+                        bottom,
+                        *litSurface,
+                        t.level(litMipLevel),
                         distance,
-                        lightPoints);
+                        playerDistanceXY,
+                        ceilingY,
+                        floorY);
+                return;
+            }
+
             lightedLine(x,
                         xProgress,
                         wallTop,
                         wallBottom,
-                        neighbourBottom + 1,
-                        visibleWallBottom,
+                        top,
+                        bottom,
                         t,
                         textureX,
+                        texelsPerColumn(x),
                         distance,
-                        lightPoints);
+                        lightPoints,
+                        lightSource,
+                        playerDistanceXY,
+                        ceilingY,
+                        floorY);
+        };
 
-            limitTop[x]    = std::clamp(std::max(visibleWallTop, neighbourTop), limitTop[x], c::renderHeight - 1);
-            limitBottom[x] = std::clamp(std::min(visibleWallBottom, neighbourBottom), 0, limitBottom[x]);
+        if (wall.portal.has_value())
+        {
+            auto neighbourTop    = std::clamp(rows.neighbourTop(x), limitTop[x], limitBottom[x]);
+            auto neighbourBottom = std::clamp(rows.neighbourBottom(x), limitTop[x], limitBottom[x]);
+
+            drawLine(visibleWallTop, neighbourTop - 1);
+            drawLine(neighbourBottom + 1, visibleWallBottom);
+
+            std::tie(limitTop[x], limitBottom[x]) = portalOpening(rows, x, limitTop[x], limitBottom[x]);
         }
         else
         {
-            textureX %= t.width;
             if (visibleWallTop >= visibleWallBottom)
             {
-#if defined(DISABLE_PARALLELISM)
-                continue;
-#else
-                    return;
-#endif
+                return;
             }
 
-            lightedLine(x,
-                        xProgress,
-                        wallTop,
-                        wallBottom,
-                        visibleWallTop,
-                        visibleWallBottom,
-                        t,
-                        textureX,
-                        distance,
-                        lightPoints);
+            drawLine(visibleWallTop, visibleWallBottom);
         }
-#if defined(DISABLE_PARALLELISM)
-    }
-#else
-        });
-#endif
-
-    auto currentRenderDepth = renderParameters.depth;
-    if (wall.portal.has_value() and currentRenderDepth > 0)
-    {
-        auto newOffsetX     = renderParameters.offsetX;
-        auto newOffsetY     = renderParameters.offsetY;
-        auto newOffsetZ     = renderParameters.offsetZ;
-        auto newOffsetAngle = renderParameters.offsetAngle;
-
-        if (wall.portal->transform.has_value())
-        {
-            const auto& transform = *wall.portal->transform;
-            newOffsetX += transform.x;
-            newOffsetY += transform.y;
-            newOffsetZ += transform.z;
-            newOffsetAngle += transform.angle;
-        }
-
-        renderQueue.push(SectorRenderParams{wall.portal->sector,
-                                            beginX,
-                                            endX,
-                                            currentRenderDepth - 1,
-                                            newOffsetX,
-                                            newOffsetY,
-                                            newOffsetZ,
-                                            newOffsetAngle});
-    }
+    };
+    pool.parallelFor(beginX, endX + 1, columnsGrain, renderColumn);
 }
 
 void Engine::lightedLine(int x,
@@ -447,84 +774,721 @@ void Engine::lightedLine(int x,
                          int wallBottom,
                          int visibleWallTop,
                          int visibleWallBottom,
-                         sdl::Surface& texture,
+                         const MipmappedTexture& texture,
                          int textureX,
+                         double texelsPerColumn,
                          double distance,
-                         const LightMap& lightMap)
+                         const LightMap& lightMap,
+                         int lightSource,
+                         double playerDistanceXY,
+                         double ceilingY,
+                         double floorY)
 {
+    if (visibleWallTop > visibleWallBottom)
+    {
+        return;
+    }
+
     double yStep     = 1 / (double)(wallBottom - wallTop + 1);
     double yProgress = yStep * (visibleWallTop - wallTop);
+    auto mapScale    = (double)(lightMap.height - 2);
+
+    // The coarser of the vertical and horizontal texel densities decides the mip level, texture row is stepped in
+    // fixed point
+    auto texelsPerRow  = texture.level(0).height / (double)(wallBottom - wallTop + 1);
+    auto mipLevel      = texture.levelFor(std::max(texelsPerRow, texelsPerColumn));
+    const auto& mip    = texture.level(mipLevel);
+    const auto* column = mip.column(textureX >> mipLevel);
+    auto textureStep   = ((int64_t)(mip.height - 1) << fixedPointShift) / std::max(wallBottom - wallTop, 1);
+    auto textureRow    = textureStep * (visibleWallTop - wallTop);
+
+    ShadingBatch batch;
+    auto flush = [&]()
+    {
+        if (deferLighting)
+        {
+            deferBatch(batch, lightSource);
+            return;
+        }
+        lighting.calculateWallLighting(batch.light, batch.count, lightMap);
+        shadeBatch(batch, playerWallLight);
+    };
 
-    for (int y = visibleWallTop; y <= visibleWallBottom; ++y, yProgress += yStep)
+    for (int y = visibleWallTop; y <= visibleWallBottom; ++y, yProgress += yStep, textureRow += textureStep)
     {
-        if (distance > zBuffer[x + y * c::renderWidth])
+        auto index = pixelIndex(x, y);
+        if (distance > zBuffer[index])
         {
             continue;
         }
-        int textureY =
-            ((texture.height - 1) * (y - wallTop) / (wallBottom - wallTop) + texture.height) % texture.height;
 
-        buffer[x + y * c::renderWidth] =
-            shadeRgb(texture.pixels()[textureX + textureY * texture.width],
-                     lighting.calculateWallLighting(xProgress, yProgress * (lightMap.height - 2), lightMap));
-        zBuffer[x + y * c::renderWidth] = distance;
+        auto playerDistanceZ = ceilingY - (ceilingY - floorY) * yProgress;
+
+        auto i                  = batch.count++;
+        batch.light.u[i]        = (float)xProgress;
+        batch.light.v[i]        = (float)(yProgress * mapScale);
+        batch.playerDistance[i] = playerDistanceXY + playerDistanceZ * playerDistanceZ;
+        batch.texels[i]         = column[(textureRow >> fixedPointShift) & mip.heightMask];
+        batch.indices[i]        = index;
+        batch.distances[i]      = distance;
+
+        if (batch.count == LightSamples::capacity)
+        {
+            flush();
+        }
     }
+    flush();
 }
 
-void Engine::renderCeilingAndFloor(const world::Sector& sector,
-                                   const game::Position& player,
-                                   int x,
-                                   int wallTop,
-                                   int wallBottom,
-                                   double ceilingY,
-                                   double floorY,
-                                   double angleSin,
-                                   double angleCos,
-                                   const OffsetLightMap& ceilingLightMap,
-                                   const OffsetLightMap& floorLightMap)
+void Engine::litLine(int x,
+                     double wallProgress,
+                     int wallTop,
+                     int wallBottom,
+                     int visibleWallTop,
+                     int visibleWallBottom,
+                     const SurfaceCache::LitSurface& surface,
+                     const MipmappedTexture::Level& mip,
+                     double distance,
+                     double playerDistanceXY,
+                     double ceilingY,
+                     double floorY)
 {
-    auto& floorTexture   = getTexture(sector.floorTexture);
-    auto& ceilingTexture = getTexture(sector.ceilingTexture);
+    if (visibleWallTop > visibleWallBottom)
+    {
+        return;
+    }
 
-    auto invFovH = (c::renderWidth / 2 - x) / player.fovH;
+    double yStep     = 1 / (double)(wallBottom - wallTop + 1);
+    double yProgress = yStep * (visibleWallTop - wallTop);
+
+    auto surfaceX      = (int)(wallProgress * surface.width);
+    const auto* column = surface.column(surfaceX);
+    const auto* texels = mip.column(surfaceX);
+    auto textureStep   = ((int64_t)(surface.height - 1) << fixedPointShift) / std::max(wallBottom - wallTop, 1);
+    auto textureRow    = textureStep * (visibleWallTop - wallTop);
 
-    for (int y = limitTop[x]; y <= limitBottom[x]; ++y)
+    // The surface holds the level lights only, the player light is added where it is close enough to show
+    auto addPlayerLight = isNoticeable(playerLighting(playerWallLight, playerDistanceXY));
+
+    for (int y = visibleWallTop; y <= visibleWallBottom; ++y, yProgress += yStep, textureRow += textureStep)
     {
-        if (y <= wallBottom and y >= wallTop)
+        auto index = pixelIndex(x, y);
+        if (distance > zBuffer[index])
         {
             continue;
         }
 
-        auto index     = x + y * c::renderWidth;
-        auto isCeiling = y < wallTop;
+        auto row   = std::clamp((int)(textureRow >> fixedPointShift), 0, surface.height - 1);
+        auto pixel = column[row];
+        if (addPlayerLight)
+        {
+            auto playerDistanceZ = ceilingY - (ceilingY - floorY) * yProgress;
+            auto playerLight =
+                playerLighting(playerWallLight, playerDistanceXY + playerDistanceZ * playerDistanceZ);
+            pixel = addShading(pixel, texels[row], playerLight.r, playerLight.g, playerLight.b);
+        }
+
+        buffer[index]  = pixel;
+        zBuffer[index] = distance;
+    }
+}
+
+std::shared_ptr<const SurfaceCache::LitSurface> Engine::litWall(const world::Sector& sector,
+                                                                const world::Wall& wall,
+                                                                const MipmappedTexture& texture,
+                                                                int mipLevel)
+{
+    auto layout = wallLayout(sector, wall, texture.level(mipLevel));
+    if (not surfaceCache.fits(layout.width, layout.height))
+    {
+        return nullptr;
+    }
+    return surfaceCache.find(sector.id, (int)std::distance(sector.walls.data(), &wall), mipLevel);
+}
+
+std::shared_ptr<const SurfaceCache::LitSurface> Engine::litPlane(const world::Sector& sector,
+                                                                 int surface,
+                                                                 const MipmappedTexture& texture,
+                                                                 int mipLevel)
+{
+    auto layout = planeLayout(sector, texture.level(mipLevel));
+    if (not surfaceCache.fits(layout.width, layout.height))
+    {
+        return nullptr;
+    }
+    return surfaceCache.find(sector.id, surface, mipLevel);
+}
+
+void Engine::buildLitSurfaces()
+{
+    for (const auto& request : surfaceCache.takeRequests())
+    {
+        const world::Sector& sector = level.sector(request.sector);
+        if (request.surface == SurfaceCache::ceiling or request.surface == SurfaceCache::floor)
+        {
+            auto [ceilingLightMap, floorLightMap] = lighting.prepareSurfaceMap(sector);
+            auto ceiling                          = request.surface == SurfaceCache::ceiling;
+            const auto& texture = getMipmaps(ceiling ? sector.ceilingTextureHandle : sector.floorTextureHandle);
+            surfaceCache.put(request,
+                             buildLitPlane(sector,
+                                           texture.level(request.mipLevel),
+                                           ceiling ? ceilingLightMap : floorLightMap));
+        }
+        else
+        {
+            const auto& wall = sector.walls[request.surface];
+            surfaceCache.put(request,
+                             buildLitWall(sector,
+                                          wall,
+                                          getMipmaps(wall.textureHandle).level(request.mipLevel),
+                                          lighting.prepareWallMap(sector, wall)));
+        }
+    }
+}
+
+SurfaceCache::LitSurface Engine::buildLitWall(const world::Sector& sector,
+                                              const world::Wall& wall,
+                                              const MipmappedTexture::Level& mip,
+                                              const LightMap& lightMap)
+{
+    auto surface = wallLayout(sector, wall, mip);
+    auto width   = surface.width;
+    auto height  = surface.height;
+    surface.pixels.resize((size_t)(width * height));
+
+    auto buildColumn = [&](int x)
+    {
+        LightSamples samples;
+        for (int first = 0; first < height; first += LightSamples::capacity)
+        {
+            auto count = std::min(LightSamples::capacity, height - first);
+            for (int i = 0; i < count; ++i)
+            {
+                samples.u[i] = (float)((x + 0.5) / width * (lightMap.width - 2));
+                samples.v[i] = (float)((first + i) / (double)std::max(height - 1, 1) * (lightMap.height - 2));
+            }
+            lighting.calculateWallLighting(samples, count, lightMap);
+            shadePixels(mip.column(x) + first, samples, count, surface.pixels.data() + x * height + first);
+        }
+    };
+    pool.parallelFor(0, width, columnsGrain, buildColumn);
+
+    return surface;
+}
+
+SurfaceCache::LitSurface Engine::buildLitPlane(const world::Sector& sector,
+                                               const MipmappedTexture::Level& mip,
+                                               const OffsetLightMap& lightMap)
+{
+    auto lit     = planeLayout(sector, mip);
+    auto width   = lit.width;
+    auto height  = lit.height;
+    auto originX = lit.originX;
+    auto originY = lit.originY;
+    lit.pixels.resize((size_t)(width * height));
+
+    // Every surface texel is lit at the center of the texture texel it was made of
+    auto buildColumn = [&](int x)
+    {
+        LightSamples samples;
+        std::array<sdl::Pixel, LightSamples::capacity> texels{};
+        for (int first = 0; first < height; first += LightSamples::capacity)
+        {
+            auto count = std::min(LightSamples::capacity, height - first);
+            for (int i = 0; i < count; ++i)
+            {
+                samples.u[i] = (float)((originX + x + 0.5) / mip.width);
+                samples.v[i] = (float)((originY + first + i + 0.5) / mip.height);
+                texels[i]    = mip.texel(originX + x, originY + first + i);
+            }
+            lighting.calculateSurfaceLighting(samples, count, lightMap);
+            shadePixels(texels.data(), samples, count, lit.pixels.data() + x * height + first);
+        }
+    };
+    pool.parallelFor(0, width, columnsGrain, buildColumn);
+
+    return lit;
+}
+
+void Engine::addPlayerLight(ShadingBatch& batch, const LightPoint& playerIntensity)
+{
+    for (int i = 0; i < batch.count; ++i)
+    {
+        auto playerLight = playerLighting(playerIntensity, batch.playerDistance[i]);
+        batch.light.r[i] += (float)playerLight.r;
+        batch.light.g[i] += (float)playerLight.g;
+        batch.light.b[i] += (float)playerLight.b;
+    }
+}
+
+void Engine::shadeBatch(ShadingBatch& batch, const LightPoint& playerIntensity)
+{
+    addPlayerLight(batch, playerIntensity);
+    shadePixels(batch.texels.data(), batch.light, batch.count, batch.shaded.data());
+    storeBatch(batch);
+}
+
+void Engine::storeBatch(ShadingBatch& batch)
+{
+    for (int i = 0; i < batch.count; ++i)
+    {
+        buffer[batch.indices[i]]  = batch.shaded[i];
+        zBuffer[batch.indices[i]] = batch.distances[i];
+    }
+    batch.count = 0;
+}
+
+int Engine::addLightSource(RenderStrip& strip, const LightSource& source)
+{
+    strip.lightSources.push_back(source);
+    return (int)strip.lightSources.size() - 1;
+}
+
+void Engine::deferBatch(ShadingBatch& batch, int lightSource)
+{
+    for (int i = 0; i < batch.count; ++i)
+    {
+        auto index                           = batch.indices[i];
+        buffer[index]                        = batch.texels[i];
+        zBuffer[index]                       = batch.distances[i];
+        geometryBuffer.source[index]         = lightSource;
+        geometryBuffer.u[index]              = batch.light.u[i];
+        geometryBuffer.v[index]              = batch.light.v[i];
+        geometryBuffer.playerDistance[index] = (float)batch.playerDistance[i];
+    }
+    batch.count = 0;
+}
+
+template<typename LightBatch>
+void Engine::collectDeferred(ShadingBatch& batch, int& batchSource, int index, int slot, const LightBatch& lightBatch)
+{
+    auto source = geometryBuffer.source[index];
+    if (source != batchSource or batch.count == LightSamples::capacity)
+    {
+        lightBatch();
+        batchSource = source;
+    }
+
+    auto i                  = batch.count++;
+    batch.light.u[i]        = geometryBuffer.u[index];
+    batch.light.v[i]        = geometryBuffer.v[index];
+    batch.playerDistance[i] = geometryBuffer.playerDistance[index];
+    batch.texels[i]         = buffer[index];
+    batch.indices[i]        = slot;
+    batch.distances[i]      = zBuffer[index];
+}
+
+void Engine::gatherLight(ShadingBatch& batch, const LightSource& source)
+{
+    if (source.wallMap != nullptr)
+    {
+        lighting.calculateWallLighting(batch.light, batch.count, *source.wallMap);
+    }
+    else if (source.surfaceMap != nullptr)
+    {
+        lighting.calculateSurfaceLighting(batch.light, batch.count, *source.surfaceMap);
+    }
+    else
+    {
+        std::fill_n(batch.light.r.begin(), batch.count, (float)source.uniform.r);
+        std::fill_n(batch.light.g.begin(), batch.count, (float)source.uniform.g);
+        std::fill_n(batch.light.b.begin(), batch.count, (float)source.uniform.b);
+        return;
+    }
+    addPlayerLight(batch, source.playerIntensity);
+}
+
+void Engine::storeLit(ShadingBatch& batch)
+{
+    shadePixels(batch.texels.data(), batch.light, batch.count, batch.shaded.data());
+    for (int i = 0; i < batch.count; ++i)
+    {
+        buffer[batch.indices[i]] = batch.shaded[i];
+    }
+    batch.count = 0;
+}
+
+void Engine::lightDeferred(RenderStrip& strip, int leftX, int rightX)
+{
+    if (c::lightingScale > 1)
+    {
+        sampleLighting(strip, leftX, rightX);
+        upsampleLighting(strip, leftX, rightX);
+        return;
+    }
+
+    // Only the pixels left visible after all sectors and sprites are drawn get here. They are lit in runs sharing a
+    // light source, which wall columns and plane spans split into naturally.
+    auto lightColumn = [&](int x)
+    {
+        ShadingBatch batch;
+        int batchSource = -1;
+
+        auto flush = [&]()
+        {
+            if (batch.count > 0)
+            {
+                gatherLight(batch, strip.lightSources[batchSource]);
+                storeLit(batch);
+            }
+        };
+
+        for (int index = pixelIndex(x, 0); index < pixelIndex(x + 1, 0); ++index)
+        {
+            if (geometryBuffer.source[index] >= 0)
+            {
+                collectDeferred(batch, batchSource, index, index, flush);
+            }
+        }
+        flush();
+    };
+    pool.parallelFor(leftX, rightX + 1, columnsGrain, lightColumn);
+}
+
+void Engine::sampleLighting(RenderStrip& strip, int leftX, int rightX)
+{
+    auto& grid   = strip.lightingGrid;
+    grid.leftX   = leftX;
+    grid.rightX  = rightX;
+    grid.height  = frameHeight;
+    grid.columns = (rightX - leftX + c::lightingScale - 1) / c::lightingScale + 1;
+    grid.rows    = (frameHeight - 1 + c::lightingScale - 1) / c::lightingScale + 1;
+    grid.r.resize((size_t)(grid.columns * grid.rows));
+    grid.g.resize(grid.r.size());
+    grid.b.resize(grid.r.size());
+
+    auto sampleColumn = [&](int column)
+    {
+        ShadingBatch batch;
+        int batchSource = -1;
 
-        auto transformedZ = (isCeiling ? ceilingY : floorY) * player.fovV / (c::renderHeight / 2 - y);
-        auto transformedX = transformedZ * invFovH;
+        auto flush = [&]()
+        {
+            if (batch.count == 0)
+            {
+                return;
+            }
 
-        auto mapX = transformedZ * angleCos + transformedX * angleSin + player.x + renderQueue.front().offsetX;
-        auto mapY = transformedZ * angleSin - transformedX * angleCos + player.y + renderQueue.front().offsetY;
+            gatherLight(batch, strip.lightSources[batchSource]);
+            for (int i = 0; i < batch.count; ++i)
+            {
+                grid.r[batch.indices[i]] = batch.light.r[i];
+                grid.g[batch.indices[i]] = batch.light.g[i];
+                grid.b[batch.indices[i]] = batch.light.b[i];
+            }
+            batch.count = 0;
+        };
 
-        auto distance =
-            std::hypot(player.x - mapX, player.y - mapY, player.z - (isCeiling ? sector.ceiling : sector.floor));
+        for (int row = 0; row < grid.rows; ++row)
+        {
+            auto index = grid.pixel(column, row);
+            if (geometryBuffer.source[index] >= 0)
+            {
+                collectDeferred(batch, batchSource, index, grid.slot(column, row), flush);
+            }
+        }
+        flush();
+    };
+    pool.parallelFor(0, grid.columns, std::max(columnsGrain / c::lightingScale, 1), sampleColumn);
+}
+
+void Engine::upsampleLighting(RenderStrip& strip, int leftX, int rightX)
+{
+    const auto& grid = strip.lightingGrid;
+
+    // Bilinear filtering between the neighbouring samples, skipping the ones taken on another wall, plane or sprite
+    // and favouring the ones at a similar depth. Pixels with no sample to use are lit on their own.
+    auto upsampleColumn = [&](int x)
+    {
+        ShadingBatch upsampled;
+        ShadingBatch missed;
+        int missedSource = -1;
+
+        auto flushMissed = [&]()
+        {
+            if (missed.count > 0)
+            {
+                gatherLight(missed, strip.lightSources[missedSource]);
+                storeLit(missed);
+            }
+        };
+
+        auto [leftColumn, rightColumn, weightX] = grid.columnsAround(x);
+
+        for (int y = 0; y < frameHeight; ++y)
+        {
+            auto index  = pixelIndex(x, y);
+            auto source = geometryBuffer.source[index];
+            if (source < 0)
+            {
+                continue;
+            }
+
+            auto [topRow, bottomRow, weightY] = grid.rowsAround(y);
+            auto depth                        = zBuffer[index];
+
+            double r = 0, g = 0, b = 0, weightSum = 0;
+            auto addSample = [&](int column, int row, double weight)
+            {
+                auto sampleIndex = grid.pixel(column, row);
+                if (weight <= 0 or geometryBuffer.source[sampleIndex] != source)
+                {
+                    return;
+                }
+
+                weight /= 1 + lightingDepthSensitivity * std::abs(zBuffer[sampleIndex] - depth) / depth;
+                auto slot = grid.slot(column, row);
+                r += weight * grid.r[slot];
+                g += weight * grid.g[slot];
+                b += weight * grid.b[slot];
+                weightSum += weight;
+            };
+            addSample(leftColumn, topRow, (1 - weightX) * (1 - weightY));
+            addSample(rightColumn, topRow, weightX * (1 - weightY));
+            addSample(leftColumn, bottomRow, (1 - weightX) * weightY);
+            addSample(rightColumn, bottomRow, weightX * weightY);
+
+            if (weightSum <= 0)
+            {
+                collectDeferred(missed, missedSource, index, index, flushMissed);
+                continue;
+            }
+
+            auto i               = upsampled.count++;
+            upsampled.light.r[i] = (float)(r / weightSum);
+            upsampled.light.g[i] = (float)(g / weightSum);
+            upsampled.light.b[i] = (float)(b / weightSum);
+            upsampled.texels[i]  = buffer[index];
+            upsampled.indices[i] = index;
+            if (upsampled.count == LightSamples::capacity)
+            {
+                storeLit(upsampled);
+            }
+        }
+        storeLit(upsampled);
+        flushMissed();
+    };
+    pool.parallelFor(leftX, rightX + 1, columnsGrain, upsampleColumn);
+}
+
+void Engine::clearPlanes(const SectorRenderParams& renderParameters)
+{
+    for (int x = renderParameters.leftXBoundary; x <= renderParameters.rightXBoundary; ++x)
+    {
+        ceilingColumns.top[x] = floorColumns.top[x] = frameHeight;
+        ceilingColumns.bottom[x] = floorColumns.bottom[x] = -1;
+    }
+}
+
+void Engine::renderPlane(RenderStrip& strip,
+                         const SectorRenderParams& renderParameters,
+                         const game::Position& player,
+                         const PlaneColumns& columns,
+                         int surface,
+                         double planeY,
+                         double angleSin,
+                         double angleCos,
+                         const MipmappedTexture& texture,
+                         const OffsetLightMap& lightMap)
+{
+    auto& spans     = strip.spans;
+    auto& spanStart = strip.spanStart;
+
+    spans.clear();
+
+    // Sweep the columns left to right, opening a span on every row that becomes visible and closing it when the row
+    // disappears again. Column ranges are contiguous, so only rows at their changing ends need to be touched.
+    int previousTop    = frameHeight;
+    int previousBottom = -1;
+    for (int x = renderParameters.leftXBoundary; x <= renderParameters.rightXBoundary + 1; ++x)
+    {
+        int top    = frameHeight;
+        int bottom = -1;
+        if (x <= renderParameters.rightXBoundary)
+        {
+            top    = columns.top[x];
+            bottom = columns.bottom[x];
+        }
+
+        int closeTop    = previousTop;
+        int closeBottom = previousBottom;
+        int openTop     = top;
+        int openBottom  = bottom;
+
+        while (closeTop < openTop and closeTop <= closeBottom)
+        {
+            spans.push_back(Span{closeTop, spanStart[closeTop], x - 1});
+            ++closeTop;
+        }
+        while (closeBottom > openBottom and closeBottom >= closeTop)
+        {
+            spans.push_back(Span{closeBottom, spanStart[closeBottom], x - 1});
+            --closeBottom;
+        }
+        while (openTop < closeTop and openTop <= openBottom)
+        {
+            spanStart[openTop++] = x;
+        }
+        while (openBottom > closeBottom and openBottom >= openTop)
+        {
+            spanStart[openBottom--] = x;
+        }
+
+        previousTop    = top;
+        previousBottom = bottom;
+    }
+
+    auto lightSource = addLightSource(strip, LightSource{nullptr, &lightMap, {}, playerSurfaceLight});
+
+    // Pre-lit surfaces are looked up once before the spans are drawn, the missing ones are built for the next frame
+    LitSurfaces litSurfaces{};
+    if (surfaceCache.enabled() and not deferLighting)
+    {
+        const auto& sector = level.sector(renderParameters.id);
+        litSurfaces.resize(texture.levelCount());
+        std::vector<bool> lookedUp(texture.levelCount());
+        for (const auto& span : spans)
+        {
+            auto mipLevel = planeMipLevel(texture, player, planeY, frameHeight / 2 - span.y);
+            if (not lookedUp[mipLevel])
+            {
+                litSurfaces[mipLevel] = litPlane(sector, surface, texture, mipLevel);
+                lookedUp[mipLevel]    = true;
+            }
+        }
+    }
+
+    pool.parallelFor(
+        0,
+        (int)spans.size(),
+        spansGrain,
+        [&](int i)
+        {
+            renderSpan(renderParameters,
+                       player,
+                       spans[i],
+                       planeY,
+                       angleSin,
+                       angleCos,
+                       texture,
+                       lightMap,
+                       lightSource,
+                       litSurfaces);
+        });
+}
+
+void Engine::renderSpan(const SectorRenderParams& renderParameters,
+                        const game::Position& player,
+                        const Span& span,
+                        double planeY,
+                        double angleSin,
+                        double angleCos,
+                        const MipmappedTexture& texture,
+                        const OffsetLightMap& lightMap,
+                        int lightSource,
+                        const LitSurfaces& litSurfaces)
+{
+    auto transformedZ = planeY * player.fovV / (frameHeight / 2 - span.y);
+    auto transformedX = transformedZ * (frameWidth / 2 - span.xStart) / player.fovH;
+    auto stepX        = -transformedZ / player.fovH;
+
+    auto mapX     = transformedZ * angleCos + transformedX * angleSin + player.x + renderParameters.offsetX;
+    auto mapY     = transformedZ * angleSin - transformedX * angleCos + player.y + renderParameters.offsetY;
+    auto mapStepX = stepX * angleSin;
+    auto mapStepY = -stepX * angleCos;
+
+    auto rowDistanceSquared = transformedZ * transformedZ + planeY * planeY;
+
+    auto mipLevel   = planeMipLevel(texture, player, planeY, frameHeight / 2 - span.y);
+    const auto& mip = texture.level(mipLevel);
+
+    constexpr static auto fixedPointOne = (double)(1 << fixedPointShift);
+    auto textureU                       = (int64_t)std::floor(mapX * mip.width * fixedPointOne);
+    auto textureV                       = (int64_t)std::floor(mapY * mip.height * fixedPointOne);
+    auto textureStepU                   = (int64_t)(mapStepX * mip.width * fixedPointOne);
+    auto textureStepV                   = (int64_t)(mapStepY * mip.height * fixedPointOne);
+
+    if (not litSurfaces.empty() and litSurfaces[mipLevel])
+    {
+        const auto& surface = *litSurfaces[mipLevel];
+
+        // The surface holds the level lights only, the player light is added where it is close enough to show
+        auto addPlayerLight = isNoticeable(playerLighting(playerSurfaceLight, rowDistanceSquared));
+
+        for (int x = span.xStart; x <= span.xEnd; ++x, transformedX += stepX)
+        {
+            auto index           = pixelIndex(x, span.y);
+            auto distanceSquared = transformedX * transformedX + rowDistanceSquared;
+            auto distance        = std::sqrt(distanceSquared);
+            if (distance > zBuffer[index])
+            {
+                continue;
+            }
+
+            auto offset = x - span.xStart;
+            auto tX     = (int)((textureU + textureStepU * offset) >> fixedPointShift);
+            auto tY     = (int)((textureV + textureStepV * offset) >> fixedPointShift);
+            auto pixel  = surface.texel(tX, tY);
+            if (addPlayerLight)
+            {
+                auto playerLight = playerLighting(playerSurfaceLight, distanceSquared);
+                pixel            = addShading(pixel, mip.texel(tX, tY), playerLight.r, playerLight.g, playerLight.b);
+            }
+
+            buffer[index]  = pixel;
+            zBuffer[index] = distance;
+        }
+        return;
+    }
+
+    ShadingBatch batch;
+    auto flush = [&]()
+    {
+        if (deferLighting)
+        {
+            deferBatch(batch, lightSource);
+            return;
+        }
+        lighting.calculateSurfaceLighting(batch.light, batch.count, lightMap);
+        shadeBatch(batch, playerSurfaceLight);
+    };
+
+    for (int x = span.xStart; x <= span.xEnd; ++x, transformedX += stepX, mapX += mapStepX, mapY += mapStepY)
+    {
+        auto index           = pixelIndex(x, span.y);
+        auto distanceSquared = transformedX * transformedX + rowDistanceSquared;
+        auto distance        = std::sqrt(distanceSquared);
         if (distance > zBuffer[index])
         {
             continue;
         }
 
-        int textureWidth  = (isCeiling ? ceilingTexture : floorTexture).width;
-        int textureHeight = (isCeiling ? ceilingTexture : floorTexture).height;
+        auto offset = x - span.xStart;
+        auto tX     = (int)((textureU + textureStepU * offset) >> fixedPointShift);
+        auto tY     = (int)((textureV + textureStepV * offset) >> fixedPointShift);
 
-        auto tX = (int)std::abs(textureWidth + mapX * textureWidth) % textureWidth;
-        auto tY = (int)std::abs(textureHeight + mapY * textureHeight) % textureHeight;
+        auto i                  = batch.count++;
+        batch.light.u[i]        = (float)mapX;
+        batch.light.v[i]        = (float)mapY;
+        batch.playerDistance[i] = distanceSquared;
+        batch.texels[i]         = mip.texel(tX, tY);
+        batch.indices[i]        = index;
+        batch.distances[i]      = distance;
 
-        buffer[index] =
-            shadeRgb((isCeiling ? ceilingTexture : floorTexture).pixels()[tX + tY * textureWidth],
-                     lighting.calculateSurfaceLighting(mapX, mapY, isCeiling ? ceilingLightMap : floorLightMap));
-        zBuffer[index] = distance;
+        if (batch.count == LightSamples::capacity)
+        {
+            flush();
+        }
     }
+    flush();
 }
 
-void Engine::renderSprites(const world::Sector& sector, const game::Position& player, double angleSin, double angleCos)
+void Engine::renderSprites(RenderStrip& strip,
+                           const SectorRenderParams& renderParameters,
+                           const world::Sector& sector,
+                           const game::Position& player,
+                           double angleSin,
+                           double angleCos)
 {
     std::vector<std::tuple<int, double>> spriteQueue{};
     spriteQueue.reserve(sector.sprites.size());
@@ -537,8 +1501,6 @@ void Engine::renderSprites(const world::Sector& sector, const game::Position& pl
               spriteQueue.end(),
               [](const auto& a, const auto& b) { return std::get<1>(a) > std::get<1>(b); });
 
-    const auto& renderParameters = renderQueue.front();
-
     for (const auto& [id, distance] : spriteQueue)
     {
         if (distance > 10)
@@ -547,7 +1509,7 @@ void Engine::renderSprites(const world::Sector& sector, const game::Position& pl
         }
 
         const auto& sprite  = sector.sprites[id];
-        const auto& texture = getTexture(sprite.texture(player.angle));
+        const auto& texture = getMipmaps(sprite.textureHandle(player.angle));
 
         auto spriteCenterX = sprite.x - player.x - renderParameters.offsetX;
         auto spriteCenterY = sprite.y - player.y - renderParameters.offsetY;
@@ -565,56 +1527,89 @@ void Engine::renderSprites(const world::Sector& sector, const game::Position& pl
         double scaleX = player.fovH * invZ;
         double scaleY = player.fovV * invZ;
 
-        int leftX  = c::renderWidth / 2 - (int)((transformedX + sprite.w / 2) * scaleX);
-        int rightX = c::renderWidth / 2 - (int)((transformedX - sprite.w / 2) * scaleX);
+        int leftX  = frameWidth / 2 - (int)((transformedX + sprite.w / 2) * scaleX);
+        int rightX = frameWidth / 2 - (int)((transformedX - sprite.w / 2) * scaleX);
 
         if (leftX >= rightX or rightX < renderParameters.leftXBoundary or leftX > renderParameters.rightXBoundary)
         {
             continue;
         }
 
-        int topY = c::renderHeight / 2 -
+        int topY = frameHeight / 2 -
                    (int)((sprite.z + sprite.offset - player.z - renderParameters.offsetZ + sprite.h / 2) * scaleY);
-        int bottomY = c::renderHeight / 2 -
+        int bottomY = frameHeight / 2 -
                       (int)((sprite.z + sprite.offset - player.z - renderParameters.offsetZ - sprite.h / 2) * scaleY);
 
-        if (topY >= bottomY or bottomY < 0 or topY >= c::renderHeight - 1)
+        if (topY >= bottomY or bottomY < 0 or topY >= frameHeight - 1)
         {
             continue;
         }
 
-        const auto& texturePixels = texture.pixels();
+        auto spriteLighting = lighting.calculateSpriteLighting(sector, sprite, player);
+        auto mipLevel       = texture.levelFor(texture.level(0).width / (double)(rightX - leftX));
+        const auto& mip     = texture.level(mipLevel);
 
         auto startX = std::clamp(leftX, renderParameters.leftXBoundary, renderParameters.rightXBoundary);
         auto endX   = std::clamp(rightX, renderParameters.leftXBoundary, renderParameters.rightXBoundary);
-        auto startY = std::clamp(topY, 0, c::renderHeight - 1);
-        auto endY   = std::clamp(bottomY, 0, c::renderHeight - 1);
+        auto startY = std::clamp(topY, 0, frameHeight - 1);
+        auto endY   = std::clamp(bottomY, 0, frameHeight - 1);
+
+        auto lightSource = addLightSource(strip, LightSource{nullptr, nullptr, spriteLighting, {}});
 
-        for (auto y = startY; y <= endY; ++y)
+        ShadingBatch batch;
+        auto flush = [&]()
         {
-            int texY = (texture.height - 1) * (y - topY) / (bottomY - topY);
-            for (auto x = startX; x <= endX; ++x)
+            if (deferLighting)
             {
-                if (distance > zBuffer[x + y * c::renderWidth])
+                // Sprites are lit uniformly, their light map coordinates are never read
+                std::fill_n(batch.light.u.begin(), batch.count, 0.0f);
+                std::fill_n(batch.light.v.begin(), batch.count, 0.0f);
+                std::fill_n(batch.playerDistance.begin(), batch.count, 0.0);
+                deferBatch(batch, lightSource);
+                return;
+            }
+            shadePixels(batch.texels.data(), spriteLighting, batch.count, batch.shaded.data());
+            storeBatch(batch);
+        };
+
+        for (auto x = startX; x <= endX; ++x)
+        {
+            const auto* column = mip.column((mip.width - 1) * (x - leftX) / (rightX - leftX));
+            for (auto y = startY; y <= endY; ++y)
+            {
+                if (distance > zBuffer[pixelIndex(x, y)])
                 {
                     continue;
                 }
-                int texX          = (texture.width - 1) * (x - leftX) / (rightX - leftX);
-                const auto& pixel = texturePixels[texX + texY * texture.width];
-                if ((pixel & 0xff'00'00'00) >> 24 == 0xff)
+                int texY          = (mip.height - 1) * (y - topY) / (bottomY - topY);
+                const auto& pixel = column[texY];
+                if ((pixel & 0xff'00'00'00) >> 24 != 0xff)
                 {
-                    buffer[x + y * c::renderWidth] =
-                        shadeRgb(pixel, lighting.calculateSpriteLighting(sector, sprite, player));
-                    zBuffer[x + y * c::renderWidth] = distance;
+                    continue;
+                }
+
+                auto i             = batch.count++;
+                batch.texels[i]    = pixel;
+                batch.indices[i]   = pixelIndex(x, y);
+                batch.distances[i] = distance;
+
+                if (batch.count == LightSamples::capacity)
+                {
+                    flush();
                 }
             }
         }
+        flush();
     }
 }
 
 void Engine::draw()
 {
-    view.update(buffer.data());
-    renderer.copy(view);
+    if (frameRendered)
+    {
+        transposeColumns(buffer.data(), frameBuffer.data(), frameWidth, frameHeight);
+        view.update(frameBuffer.data(), frameWidth, frameHeight);
+    }
+    renderer.copy(view, sdl::FRectangle{0, 0, (float)frameWidth, (float)frameHeight});
 }
 } // namespace engine
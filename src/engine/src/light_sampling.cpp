@@ -0,0 +1,163 @@
+#include "light_sampling.hpp"
+
+#include "lighting.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) or defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace engine
+{
+namespace
+{
+void sampleScalar(const LightMap& lightMap, LightSamples& samples, int first, int count)
+{
+    auto maxX  = (float)(lightMap.width - 2);
+    auto maxY  = (float)(lightMap.height - 2);
+    auto width = lightMap.width;
+
+    for (int i = first; i < count; ++i)
+    {
+        auto floorU = std::floor(samples.u[i]);
+        auto floorV = std::floor(samples.v[i]);
+        auto stepX  = std::clamp(samples.u[i] - floorU, 0.0f, 1.0f);
+        auto stepY  = std::clamp(samples.v[i] - floorV, 0.0f, 1.0f);
+        auto index  = (int)std::clamp(floorU, 0.0f, maxX) + (int)std::clamp(floorV, 0.0f, maxY) * width;
+
+        auto interpolate = [index, width, stepX, stepY](const std::vector<float>& plane)
+        {
+            auto top    = plane[index] + (plane[index + 1] - plane[index]) * stepX;
+            auto bottom = plane[index + width] + (plane[index + width + 1] - plane[index + width]) * stepX;
+            return top + (bottom - top) * stepY;
+        };
+
+        samples.r[i] = interpolate(lightMap.r);
+        samples.g[i] = interpolate(lightMap.g);
+        samples.b[i] = interpolate(lightMap.b);
+    }
+}
+
+#if defined(__AVX2__)
+int sampleVectorized(const LightMap& lightMap, LightSamples& samples, int count)
+{
+    const auto zero  = _mm256_setzero_ps();
+    const auto one   = _mm256_set1_ps(1.0f);
+    const auto maxX  = _mm256_set1_ps((float)(lightMap.width - 2));
+    const auto maxY  = _mm256_set1_ps((float)(lightMap.height - 2));
+    const auto width = _mm256_set1_ps((float)lightMap.width);
+    const auto right = _mm256_set1_epi32(1);
+    const auto below = _mm256_set1_epi32(lightMap.width);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto u      = _mm256_load_ps(&samples.u[i]);
+        auto v      = _mm256_load_ps(&samples.v[i]);
+        auto floorU = _mm256_floor_ps(u);
+        auto floorV = _mm256_floor_ps(v);
+        auto stepX  = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(u, floorU), zero), one);
+        auto stepY  = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(v, floorV), zero), one);
+        auto cellX  = _mm256_min_ps(_mm256_max_ps(floorU, zero), maxX);
+        auto cellY  = _mm256_min_ps(_mm256_max_ps(floorV, zero), maxY);
+
+        auto topLeft     = _mm256_cvttps_epi32(_mm256_add_ps(cellX, _mm256_mul_ps(cellY, width)));
+        auto topRight    = _mm256_add_epi32(topLeft, right);
+        auto bottomLeft  = _mm256_add_epi32(topLeft, below);
+        auto bottomRight = _mm256_add_epi32(bottomLeft, right);
+
+        auto interpolate = [&](const std::vector<float>& plane, float* target)
+        {
+            const auto* data = plane.data();
+            auto tl          = _mm256_i32gather_ps(data, topLeft, 4);
+            auto tr          = _mm256_i32gather_ps(data, topRight, 4);
+            auto bl          = _mm256_i32gather_ps(data, bottomLeft, 4);
+            auto br          = _mm256_i32gather_ps(data, bottomRight, 4);
+            auto top         = _mm256_add_ps(tl, _mm256_mul_ps(_mm256_sub_ps(tr, tl), stepX));
+            auto bottom      = _mm256_add_ps(bl, _mm256_mul_ps(_mm256_sub_ps(br, bl), stepX));
+            _mm256_store_ps(target, _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), stepY)));
+        };
+
+        interpolate(lightMap.r, &samples.r[i]);
+        interpolate(lightMap.g, &samples.g[i]);
+        interpolate(lightMap.b, &samples.b[i]);
+    }
+
+    return i;
+}
+#elif defined(__SSE2__) or defined(_M_X64)
+// SSE2 has no rounding instructions, so round the truncated value down where it went up
+__m128 floorPs(__m128 value)
+{
+    auto truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), _mm_set1_ps(1.0f)));
+}
+
+int sampleVectorized(const LightMap& lightMap, LightSamples& samples, int count)
+{
+    const auto zero  = _mm_setzero_ps();
+    const auto one   = _mm_set1_ps(1.0f);
+    const auto maxX  = _mm_set1_ps((float)(lightMap.width - 2));
+    const auto maxY  = _mm_set1_ps((float)(lightMap.height - 2));
+    const auto width = _mm_set1_ps((float)lightMap.width);
+    const auto below = lightMap.width;
+
+    alignas(16) std::array<int, 4> indices{};
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        auto u      = _mm_load_ps(&samples.u[i]);
+        auto v      = _mm_load_ps(&samples.v[i]);
+        auto floorU = floorPs(u);
+        auto floorV = floorPs(v);
+        auto stepX  = _mm_min_ps(_mm_max_ps(_mm_sub_ps(u, floorU), zero), one);
+        auto stepY  = _mm_min_ps(_mm_max_ps(_mm_sub_ps(v, floorV), zero), one);
+        auto cellX  = _mm_min_ps(_mm_max_ps(floorU, zero), maxX);
+        auto cellY  = _mm_min_ps(_mm_max_ps(floorV, zero), maxY);
+        _mm_store_si128((__m128i*)indices.data(), _mm_cvttps_epi32(_mm_add_ps(cellX, _mm_mul_ps(cellY, width))));
+
+        // No gathers before AVX2, the corners are loaded one by one
+        auto interpolate = [&](const std::vector<float>& plane, float* target)
+        {
+            const auto* data = plane.data();
+            auto corner      = [data, &indices](int offset)
+            {
+                return _mm_setr_ps(data[indices[0] + offset],
+                                   data[indices[1] + offset],
+                                   data[indices[2] + offset],
+                                   data[indices[3] + offset]);
+            };
+            auto tl     = corner(0);
+            auto tr     = corner(1);
+            auto bl     = corner(below);
+            auto br     = corner(below + 1);
+            auto top    = _mm_add_ps(tl, _mm_mul_ps(_mm_sub_ps(tr, tl), stepX));
+            auto bottom = _mm_add_ps(bl, _mm_mul_ps(_mm_sub_ps(br, bl), stepX));
+            _mm_store_ps(target, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), stepY)));
+        };
+
+        interpolate(lightMap.r, &samples.r[i]);
+        interpolate(lightMap.g, &samples.g[i]);
+        interpolate(lightMap.b, &samples.b[i]);
+    }
+
+    return i;
+}
+#else
+int sampleVectorized(const LightMap&, LightSamples&, int)
+{
+    return 0;
+}
+#endif
+} // namespace
+
+void sampleLightMap(const LightMap& lightMap, LightSamples& samples, int count)
+{
+    sampleScalar(lightMap, samples, sampleVectorized(lightMap, samples, count), count);
+}
+} // namespace engine
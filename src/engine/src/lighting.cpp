@@ -1,32 +1,23 @@
 #include "lighting.hpp"
 
 #include "game/player.hpp"
+#include "light_sampling.hpp"
 #include "sdlwrapper/surface.hpp"
+#include "thread_pool.hpp"
 #include "util/constants.hpp"
 #include "utilities.hpp"
 #include "world/level.hpp"
 #include "world/sector.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <queue>
-
-#if not defined(DISABLE_PARALLELISM)
-    #include <boost/iterator/counting_iterator.hpp>
-    #ifdef __APPLE__
-        #include <oneapi/dpl/algorithm>
-        #include <oneapi/dpl/execution>
-    #else
-        #include <execution>
-    #endif
-#endif
+#include <spdlog/spdlog.h>
+#include <tuple>
+#include <utility>
 
 namespace
 {
-double invMapRes;
-double mapRes;
-int depth;
-
 struct P
 {
     double x, y;
@@ -59,295 +50,562 @@ constexpr auto side(P lineStart, P lineEnd, P point)
     return (point.x - lineStart.x) * (lineEnd.y - lineStart.y) - (point.y - lineStart.y) * (lineEnd.x - lineStart.x);
 }
 
-struct GatheredSector
+// Inverse square falloff, additionally multiplied by (1 - (d/r)^2)^2 to fade out to zero at the light radius r, if the
+// light has one
+double attenuation(const world::Light& light, double distanceSquared)
+{
+    if (light.radius <= 0)
+    {
+        return 1 / distanceSquared;
+    }
+
+    auto ratio = distanceSquared / (light.radius * light.radius);
+    if (ratio >= 1)
+    {
+        return 0;
+    }
+
+    auto window = 1 - ratio;
+    return window * window / distanceSquared;
+}
+
+// Checks whether the light can reach anything within the bounds of the sector
+bool reaches(const world::Light& light, const world::Sector& sector)
+{
+    if (light.radius <= 0)
+    {
+        return true;
+    }
+
+    auto deltaX = light.x - std::clamp(light.x, sector.boundsLeft, sector.boundsRight);
+    auto deltaY = light.y - std::clamp(light.y, sector.boundsTop, sector.boundsBottom);
+    return deltaX * deltaX + deltaY * deltaY < light.radius * light.radius;
+}
+
+struct WallMapGeometry
 {
-    const world::Sector& sector;
-    std::optional<P> boundaryLeft;
-    std::optional<P> boundaryRight;
-    int caller, depth;
+    WallMapGeometry(const world::Sector& sector, const world::Wall& wall, double resolution)
+        : width((int)(std::hypot(wall.xEnd - wall.xStart, wall.yEnd - wall.yStart) * resolution) + 1)
+        , height((int)(resolution * (sector.ceiling - sector.floor)) + 1)
+        , startX(wall.xStart)
+        , startY(wall.yStart)
+        , ceiling(sector.ceiling)
+        , stepX((wall.xEnd - wall.xStart) / (double)width)
+        , stepY((wall.yEnd - wall.yStart) / (double)width)
+        , stepZ((sector.ceiling - sector.floor) / (double)height)
+    {
+    }
+
+    [[nodiscard]] std::tuple<double, double, double> position(int i, int j) const
+    {
+        return {stepX * i + startX, stepY * i + startY, ceiling - stepZ * j};
+    }
+
+    int width, height;
+    double startX, startY, ceiling;
+    double stepX, stepY, stepZ;
+};
+
+struct SurfaceMapGeometry
+{
+    SurfaceMapGeometry(const world::Sector& sector, double resolution)
+        : step(1.0 / resolution)
+        , x(sector.boundsLeft - step)
+        , y(sector.boundsTop - step)
+        , width((int)((sector.boundsRight + 2 * step - x) * resolution) + 1)
+        , height((int)((sector.boundsBottom + 2 * step - y) * resolution) + 1)
+    {
+    }
+
+    [[nodiscard]] std::pair<double, double> position(int i, int j) const { return {x + step * i, y + step * j}; }
+
+    double step, x, y;
+    int width, height;
 };
 } // namespace
 
 namespace engine
 {
+LightMap::LightMap(int width, int height)
+    : width(width)
+    , height(height)
+    , r((size_t)(width * height))
+    , g((size_t)(width * height))
+    , b((size_t)(width * height))
+{
+}
 
-Lighting::Lighting(const world::Level& level, TextureGetter textureGetter)
+void LightMap::store(int index, const LightPoint& lightPoint)
+{
+    r[index] = (float)(lightPoint.r / 2);
+    g[index] = (float)(lightPoint.g / 2);
+    b[index] = (float)(lightPoint.b / 2);
+}
+
+Lighting::Lighting(const world::Level& level, ThreadPool& pool, TextureGetter textureGetter)
     : level(level)
+    , pool(pool)
     , getTexture(std::move(textureGetter))
+    , fullQuality{c::shadowResolution, c::shadowDepth}
 {
-    invMapRes = c::shadowResolution;
-    mapRes    = 1.0 / invMapRes;
-    depth     = c::shadowDepth;
+    if (c::coarseShadowResolution > 0)
+    {
+        coarseQuality = Quality{std::min(c::coarseShadowResolution, c::shadowResolution),
+                                std::clamp(c::coarseShadowDepth, 0, c::shadowDepth)};
+    }
 }
 
 Lighting::~Lighting() = default;
 
-LightPoint Lighting::calculateWallLighting(double mapX, double mapY, const LightMap& lightMap)
+void Lighting::calculateWallLighting(LightSamples& samples, int count, const LightMap& lightMap)
 {
-    auto lightMapX = (int)(mapX);
-    auto lightMapY = (int)(mapY);
+    sampleLightMap(lightMap, samples, count);
+}
 
-    auto stepX    = std::clamp(mapX - lightMapX, 0.0, 1.0);
-    auto stepY    = std::clamp(mapY - lightMapY, 0.0, 1.0);
-    auto invStepX = 1.0 - stepX;
-    auto invStepY = 1.0 - stepY;
+void Lighting::calculateSurfaceLighting(LightSamples& samples, int count, const OffsetLightMap& lightMap)
+{
+    auto scale   = (float)lightMap.scale;
+    auto offsetX = (float)(lightMap.x * lightMap.scale);
+    auto offsetY = (float)(lightMap.y * lightMap.scale);
+    for (int i = 0; i < count; ++i)
+    {
+        samples.u[i] = samples.u[i] * scale - offsetX;
+        samples.v[i] = samples.v[i] * scale - offsetY;
+    }
+
+    sampleLightMap(lightMap, samples, count);
+}
+
+const Lighting::SectorLightMaps& Lighting::staticMaps(const world::Sector& sector)
+{
+    if (cacheRevision != level.revision())
+    {
+        SPDLOG_DEBUG("Level revision changed, dropping {} cached light maps", cache.size());
+        cache.clear();
+        casterCache.clear();
+        reachableCache.clear();
+        cacheRevision = level.revision();
+    }
 
-    auto& lmXcYc = lightMap.map[lightMapX + lightMapY * lightMap.width];
-    auto& lmXnYc = lightMap.map[(lightMapX + 1) + lightMapY * lightMap.width];
-    auto& lmXcYn = lightMap.map[lightMapX + (lightMapY + 1) * lightMap.width];
-    auto& lmXnYn = lightMap.map[(lightMapX + 1) + (lightMapY + 1) * lightMap.width];
+    if (auto cached = cache.find(sector.id); cached != cache.end())
+    {
+        return cached->second;
+    }
 
-    return lmXcYc * (invStepX * invStepY / 2) + lmXnYc * (stepX * invStepY / 2) + lmXcYn * (invStepX * stepY / 2) +
-           lmXnYn * (stepX * stepY / 2);
+    auto maps   = bakeSector(sector, coarseQuality.value_or(fullQuality));
+    maps.coarse = coarseQuality.has_value();
+    return cache.emplace(sector.id, std::move(maps)).first->second;
 }
 
-LightPoint Lighting::calculateSurfaceLighting(double mapX, double mapY, const OffsetLightMap& lightMap)
+Lighting::SectorLightMaps Lighting::bakeSector(const world::Sector& sector, const Quality& quality)
 {
-    double nearestX = std::floor(mapX * invMapRes) * mapRes;
-    double nearestY = std::floor(mapY * invMapRes) * mapRes;
+    const auto& sectorCasters = shadowCasters(sector);
+    const auto& reachable     = reachableLights(sector);
 
-    auto lightMapX = std::clamp((int)((nearestX - lightMap.x) * invMapRes), 0, lightMap.width - 2);
-    auto lightMapY = std::clamp((int)((nearestY - lightMap.y) * invMapRes), 0, lightMap.height - 2);
+    auto [ceiling, floor] = bakeSurfaceMap(sector, sectorCasters, reachable, quality);
+    std::vector<LightMap> walls{};
+    walls.reserve(sector.walls.size());
+    for (const auto& wall : sector.walls)
+    {
+        walls.emplace_back(bakeWallMap(sector, wall, sectorCasters, reachable, quality));
+    }
+    std::vector<LightPoint> sprites{};
+    sprites.reserve(sector.sprites.size());
+    for (const auto& sprite : sector.sprites)
+    {
+        sprites.emplace_back(bakeSpriteLighting(sector, sprite));
+    }
 
-    auto stepX    = std::clamp((mapX - nearestX) * invMapRes, 0.0, 1.0);
-    auto stepY    = std::clamp((mapY - nearestY) * invMapRes, 0.0, 1.0);
-    auto invStepX = 1.0 - stepX;
-    auto invStepY = 1.0 - stepY;
+    return SectorLightMaps{std::move(ceiling), std::move(floor), std::move(walls), std::move(sprites), false};
+}
 
-    auto& lmXcYc = lightMap.map[lightMapX + lightMapY * lightMap.width];
-    auto& lmXnYc = lightMap.map[(lightMapX + 1) + lightMapY * lightMap.width];
-    auto& lmXcYn = lightMap.map[lightMapX + (lightMapY + 1) * lightMap.width];
-    auto& lmXnYn = lightMap.map[(lightMapX + 1) + (lightMapY + 1) * lightMap.width];
+bool Lighting::refine(const world::Sector& sector)
+{
+    // Light maps of an older level revision are dropped and baked again on their next use anyway
+    auto cached = cache.find(sector.id);
+    if (cacheRevision != level.revision() or cached == cache.end() or not cached->second.coarse)
+    {
+        return false;
+    }
 
-    return lmXcYc * (invStepX * invStepY / 2) + lmXnYc * (stepX * invStepY / 2) + lmXcYn * (invStepX * stepY / 2) +
-           lmXnYn * (stepX * stepY / 2);
+    if (not prefetched.valid())
+    {
+        SPDLOG_DEBUG("Refining light maps of sector {}", sector.id);
+        bakeInBackground({sector.id});
+    }
+    return true;
+}
+
+uint64_t Lighting::revision() const
+{
+    return level.revision() + refinements;
 }
 
-LightMap Lighting::prepareWallMap(const world::Sector& sector, const world::Wall& wall, const game::Position& player)
+std::vector<int> Lighting::takeRefinedSectors()
 {
-    auto lightMapWidth  = (int)(std::hypot(wall.xEnd - wall.xStart, wall.yEnd - wall.yStart) * invMapRes) + 1;
-    auto lightMapHeight = (int)(invMapRes * (sector.ceiling - sector.floor)) + 1;
+    return std::exchange(refinedSectors, {});
+}
+
+void Lighting::prefetch(std::vector<int> sectors)
+{
+    if (prefetched.valid() or cacheRevision != level.revision())
+    {
+        return;
+    }
+
+    // Coarse light maps would only be refined later, so the full quality ones are baked right away
+    std::erase_if(sectors,
+                  [this](int id)
+                  {
+                      auto cached = cache.find(id);
+                      return cached != cache.end() and not cached->second.coarse;
+                  });
+    if (sectors.empty())
+    {
+        return;
+    }
+
+    SPDLOG_DEBUG("Prefetching light maps of {} sectors", sectors.size());
+    bakeInBackground(std::move(sectors));
+}
+
+void Lighting::bakeInBackground(std::vector<int> sectors)
+{
+    // The copy of the level lets scripts modify the original while baking, it is only made again once they do
+    if (not snapshot or prefetchRevision != level.revision())
+    {
+        snapshot = std::make_shared<const world::Level>(level);
+    }
+    prefetchRevision = level.revision();
 
-    double stepSize = 1.0 / (double)lightMapWidth;
-    double stepX    = (wall.xEnd - wall.xStart) * stepSize;
-    double stepY    = (wall.yEnd - wall.yStart) * stepSize;
-    double stepZ    = (sector.ceiling - sector.floor) / (double)lightMapHeight;
+    // Waits of the frame loops would otherwise run the background bake rows and stall the frame
+    if (not prefetchPool)
+    {
+        prefetchPool = std::make_unique<ThreadPool>(std::max(c::prefetchThreads, 1));
+    }
 
-    LightMap lightMap{lightMapWidth, lightMapHeight, {(size_t)(lightMapWidth * lightMapHeight), {0, 0, 0}}};
+    // A separate instance keeps the caches apart
+    prefetched = std::async(std::launch::async,
+                            [this, snapshot = snapshot, sectors = std::move(sectors)]()
+                            {
+                                Lighting detached{*snapshot, *prefetchPool, getTexture};
+                                std::unordered_map<int, SectorLightMaps> baked{};
+                                for (auto id : sectors)
+                                {
+                                    baked.emplace(id, detached.bakeSector(snapshot->sector(id), fullQuality));
+                                }
+                                return baked;
+                            });
+}
 
-    std::vector queues{(size_t)lightMapHeight, std::queue<GatheredSector>{}};
+void Lighting::collectPrefetched()
+{
+    if (not prefetched.valid() or prefetched.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return;
+    }
 
-#if defined(DISABLE_PARALLELISM)
-    for (int j = 0; j < lightMapHeight; ++j)
-#else
-    std::for_each(std::execution::par,
-                  boost::counting_iterator(0),
-                  boost::counting_iterator(lightMapHeight),
-                  [&](int j)
-#endif
+    auto maps = prefetched.get();
+    if (prefetchRevision != level.revision() or cacheRevision != level.revision())
     {
-        double z = sector.ceiling - stepZ * j;
-        for (int i = 0; i < lightMapWidth; ++i)
+        SPDLOG_DEBUG("Level revision changed, dropping {} prefetched light maps", maps.size());
+        return;
+    }
+
+    for (auto& [id, sectorMaps] : maps)
+    {
+        auto cached = cache.find(id);
+        if (cached == cache.end())
         {
-            double x = stepX * i + wall.xStart;
-            double y = stepY * i + wall.yStart;
-            LightPoint lightPoint{};
+            cache.emplace(id, std::move(sectorMaps));
+        }
+        else if (cached->second.coarse and not sectorMaps.coarse)
+        {
+            cached->second = std::move(sectorMaps);
+            refinedSectors.push_back(id);
+            ++refinements;
+        }
+    }
+}
 
-            auto playerLight = world::Light{player.x, player.y, player.z, 0.3, 0.3, 0.375};
+void Lighting::finishPrefetch()
+{
+    if (prefetched.valid())
+    {
+        prefetched.wait();
+    }
+    collectPrefetched();
+}
 
-            auto& gatheringQueue = queues[j];
-            gatheringQueue.emplace(GatheredSector{sector, std::nullopt, std::nullopt, -1, depth});
+const Lighting::ShadowCasters& Lighting::shadowCasters(const world::Sector& sector)
+{
+    if (auto cached = casterCache.find(sector.id); cached != casterCache.end())
+    {
+        return cached->second;
+    }
 
-            while (not gatheringQueue.empty())
+    ShadowCasters sectorCasters{};
+    auto addCasters = [this, &sectorCasters](const world::Sector& source)
+    {
+        for (const auto& sprite : source.sprites)
+        {
+            if (sprite.shadows)
             {
-                gatherLights(
-                    gatheringQueue,
-                    x,
-                    y,
-                    player,
-                    playerLight,
-                    [&lightPoint, &sector, &player, x, y, z, this](const world::Light& light,
-                                                                   const world::Sector& currentSector)
-                    { addLight(lightPoint, sector, light, player, x, y, z); },
-                    [x, y, &gatheringQueue]()
-                    {
-                        auto& bounds1 = gatheringQueue.front().boundaryLeft;
-                        auto& bounds2 = gatheringQueue.front().boundaryRight;
-                        if (not bounds1 or not bounds2)
-                        {
-                            return false;
-                        }
-                        return ((x == bounds1->x) or (x == bounds2->x)) and ((y == bounds1->y) or (y == bounds2->y));
-                    });
+                sectorCasters.push_back(ShadowCaster{sprite.x,
+                                                     sprite.y,
+                                                     sprite.h,
+                                                     sprite.z + sprite.h / 2,
+                                                     sprite.z - sprite.h / 2,
+                                                     sprite.textureHandle(0)});
             }
+        }
+    };
 
-            lightMap.map[i + j * lightMapWidth] = lightPoint;
+    addCasters(sector);
+    for (const auto& wall : sector.walls)
+    {
+        if (wall.portal)
+        {
+            addCasters(level.sector(wall.portal->sector));
         }
-#if defined(DISABLE_PARALLELISM)
     }
-#else
-                  });
-#endif
-    // clang-format on
-    return lightMap;
+
+    return casterCache.emplace(sector.id, std::move(sectorCasters)).first->second;
 }
 
-std::pair<OffsetLightMap, OffsetLightMap> Lighting::prepareSurfaceMap(const world::Sector& sector,
-                                                                      const game::Position& player)
+const Lighting::ReachableLights& Lighting::reachableLights(const world::Sector& sector)
 {
-    auto leftX   = sector.boundsLeft - mapRes;
-    auto rightX  = sector.boundsRight + 2 * mapRes;
-    auto topY    = sector.boundsTop - mapRes;
-    auto bottomY = sector.boundsBottom + 2 * mapRes;
+    if (auto cached = reachableCache.find(sector.id); cached != reachableCache.end())
+    {
+        return cached->second;
+    }
+
+    ReachableLights reachable{};
+    std::vector<PortalWindow> portals{};
+    collectLightPaths(reachable, portals, sector, sector, -1, fullQuality.depth);
 
-    int width  = (int)((rightX - leftX) * invMapRes) + 1;
-    int height = (int)((bottomY - topY) * invMapRes) + 1;
+    return reachableCache.emplace(sector.id, std::move(reachable)).first->second;
+}
 
-    OffsetLightMap lightMapCeiling{{width, height, {(size_t)(width * height), {0, 0, 0}}}, leftX, topY};
-    OffsetLightMap lightMapFloor{{width, height, {(size_t)(width * height), {0, 0, 0}}}, leftX, topY};
+void Lighting::collectLightPaths(ReachableLights& reachable,
+                                 std::vector<PortalWindow>& portals,
+                                 const world::Sector& origin,
+                                 const world::Sector& current,
+                                 int caller,
+                                 int remainingDepth)
+{
+    if (std::ranges::any_of(current.lights, [&origin](const auto& light) { return reaches(light, origin); }))
+    {
+        reachable.paths.push_back(LightPath{&current, reachable.portals.size(), portals.size()});
+        reachable.portals.insert(reachable.portals.end(), portals.begin(), portals.end());
+    }
 
-    std::vector queues{(size_t)height, std::queue<GatheredSector>{}};
+    if (remainingDepth <= 0)
+    {
+        return;
+    }
 
-#if defined(DISABLE_PARALLELISM)
-    for (int y = 0; y < height; ++y)
-#else
-    std::for_each(
-        std::execution::par,
-        boost::counting_iterator(0),
-        boost::counting_iterator(height),
-        [&](int y)
-#endif
+    for (const auto& wall : current.walls)
+    {
+        if (not wall.portal or wall.portal->sector == caller)
+        {
+            continue;
+        }
+
+        // Portal chains which no line can pass through never let any light in, whatever the sample position
+        portals.push_back(PortalWindow{wall.xStart, wall.yStart, wall.xEnd, wall.yEnd});
+        if (stabbable(portals))
+        {
+            collectLightPaths(reachable,
+                              portals,
+                              origin,
+                              level.sector(wall.portal->sector),
+                              current.id,
+                              remainingDepth - 1);
+        }
+        portals.pop_back();
+    }
+}
+
+const LightMap& Lighting::prepareWallMap(const world::Sector& sector, const world::Wall& wall)
+{
+    return staticMaps(sector).walls[std::distance(sector.walls.data(), &wall)];
+}
+
+std::pair<const OffsetLightMap&, const OffsetLightMap&> Lighting::prepareSurfaceMap(const world::Sector& sector)
+{
+    const auto& maps = staticMaps(sector);
+    return {maps.ceiling, maps.floor};
+}
+
+LightMap Lighting::bakeWallMap(const world::Sector& sector,
+                               const world::Wall& wall,
+                               const ShadowCasters& casters,
+                               const ReachableLights& reachable,
+                               const Quality& quality)
+{
+    auto geometry = WallMapGeometry{sector, wall, quality.resolution};
+
+    LightMap lightMap{geometry.width, geometry.height};
+
+    auto bakeRow = [&](int j)
+    {
+        for (int i = 0; i < geometry.width; ++i)
+        {
+            auto [x, y, z] = geometry.position(i, j);
+            LightPoint lightPoint{};
+
+            gatherLights(
+                reachable,
+                quality.depth,
+                x,
+                y,
+                [&lightPoint, &casters, x, y, z, this](const world::Light& light, const world::Sector& currentSector)
+                { addLight(lightPoint, casters, light, x, y, z); },
+                [x, y](const P& bounds1, const P& bounds2)
+                {
+                    return ((x == bounds1.x) or (x == bounds2.x)) and ((y == bounds1.y) or (y == bounds2.y));
+                });
+
+            lightMap.store(i + j * geometry.width, lightPoint);
+        }
+    };
+    pool.parallelFor(0, geometry.height, 1, bakeRow);
+
+    return lightMap;
+}
+
+std::pair<OffsetLightMap, OffsetLightMap> Lighting::bakeSurfaceMap(const world::Sector& sector,
+                                                                   const ShadowCasters& casters,
+                                                                   const ReachableLights& reachable,
+                                                                   const Quality& quality)
+{
+    auto geometry = SurfaceMapGeometry{sector, quality.resolution};
+    auto width    = geometry.width;
+    auto height   = geometry.height;
+
+    OffsetLightMap lightMapCeiling{{width, height}, geometry.x, geometry.y, quality.resolution};
+    OffsetLightMap lightMapFloor{{width, height}, geometry.x, geometry.y, quality.resolution};
+
+    auto bakeRow = [&](int y)
     {
         for (int x = 0; x < width; ++x)
         {
             LightPoint top{0.0, 0.0, 0.0};
             LightPoint bottom{0.0, 0.0, 0.0};
 
-            auto mapX = leftX + mapRes * x;
-            auto mapY = topY + mapRes * y;
-
-            auto playerLight = world::Light{player.x, player.y, player.z, 0.1, 0.1, 0.125};
+            auto [mapX, mapY] = geometry.position(x, y);
 
-            auto& gatheringQueue = queues[y];
-            gatheringQueue.emplace(GatheredSector{sector, std::nullopt, std::nullopt, -1, depth});
-
-            while (not gatheringQueue.empty())
-            {
-                gatherLights(
-                    gatheringQueue,
-                    mapX,
-                    mapY,
-                    player,
-                    playerLight,
-                    [&top, &bottom, &sector, &player, mapX, mapY, this](const world::Light& light,
-                                                                        const world::Sector& currentSector)
-                    {
-                        addLight(top, sector, light, player, mapX, mapY, currentSector.ceiling);
-                        addLight(bottom, sector, light, player, mapX, mapY, currentSector.floor);
-                    },
-                    [x, y, width, height, mapX, mapY, &gatheringQueue]()
-                    {
-                        auto& bounds1 = gatheringQueue.front().boundaryLeft;
-                        auto& bounds2 = gatheringQueue.front().boundaryRight;
-                        if (not bounds1 or not bounds2)
-                        {
-                            return false;
-                        }
-                        return (x < 1 or y < 1 or x > width - 2 or y > height - 2) and
-                               ((bounds1->x == mapX and bounds2->x == mapX) or
-                                (bounds1->y == mapY and bounds2->y == mapY));
-                    });
-            }
+            gatherLights(
+                reachable,
+                quality.depth,
+                mapX,
+                mapY,
+                [&top, &bottom, &casters, mapX, mapY, this](const world::Light& light,
+                                                            const world::Sector& currentSector)
+                {
+                    addLight(top, casters, light, mapX, mapY, currentSector.ceiling);
+                    addLight(bottom, casters, light, mapX, mapY, currentSector.floor);
+                },
+                [x, y, width, height, mapX, mapY](const P& bounds1, const P& bounds2)
+                {
+                    return (x < 1 or y < 1 or x > width - 2 or y > height - 2) and
+                           ((bounds1.x == mapX and bounds2.x == mapX) or (bounds1.y == mapY and bounds2.y == mapY));
+                });
 
-            lightMapCeiling.map[x + y * width] = top;
-            lightMapFloor.map[x + y * width]   = bottom;
+            lightMapCeiling.store(x + y * width, top);
+            lightMapFloor.store(x + y * width, bottom);
         }
-#if defined(DISABLE_PARALLELISM)
-    }
-#else
-        });
-#endif
+    };
+    pool.parallelFor(0, height, 1, bakeRow);
 
     return std::make_pair(std::move(lightMapCeiling), std::move(lightMapFloor));
 }
 
-void Lighting::gatherLights(std::queue<GatheredSector>& gatheringQueue,
+template<typename LightVisitor, typename LightPredicate>
+void Lighting::gatherLights(const ReachableLights& reachable,
+                            int depth,
                             double mapX,
                             double mapY,
-                            const game::Position& player,
-                            const world::Light& playerLight,
-                            const LightAdder& lightAdder,
+                            const LightVisitor& lightVisitor,
                             const LightPredicate& lightPredicate)
 {
-    auto current = gatheringQueue.front();
+    P point{mapX, mapY};
 
-    if (current.sector.id == player.sector)
+    for (const auto& path : reachable.paths)
     {
-        lightAdder(playerLight, current.sector);
-    }
+        // The paths are collected for the full shadow depth, lower qualities skip the longer ones
+        if (path.portalCount > (size_t)depth)
+        {
+            continue;
+        }
 
-    for (const auto& light : current.sector.lights)
-    {
-        if (((not current.boundaryLeft or side({mapX, mapY}, *current.boundaryLeft, light) <= 0) and
-             (not current.boundaryRight or side(*current.boundaryRight, {mapX, mapY}, light) <= 0)) or
-            lightPredicate())
+        auto bounded = path.portalCount > 0;
+        auto visible = true;
+        P boundaryLeft{0, 0};
+        P boundaryRight{0, 0};
+
+        // Narrow the view from the sample point down to the part seen through all the portals on the way
+        for (size_t i = 0; i < path.portalCount and visible; ++i)
+        {
+            const auto& portal = reachable.portals[path.firstPortal + i];
+            P portalStart{portal.xStart, portal.yStart};
+            P portalEnd{portal.xEnd, portal.yEnd};
+
+            if (i == 0)
+            {
+                boundaryLeft  = portalStart;
+                boundaryRight = portalEnd;
+                continue;
+            }
+
+            auto side1 = side(point, boundaryLeft, portalStart);
+            auto side2 = side(boundaryRight, point, portalStart);
+            auto side3 = side(point, boundaryLeft, portalEnd);
+            auto side4 = side(boundaryRight, point, portalEnd);
+
+            visible = side2 <= 0 and side3 <= 0;
+
+            if (side1 <= 0)
+            {
+                boundaryLeft = portalStart;
+            }
+            if (side4 <= 0)
+            {
+                boundaryRight = portalEnd;
+            }
+        }
+
+        if (not visible)
         {
-            lightAdder(light, current.sector);
+            continue;
         }
-    }
 
-    if (current.depth > 0)
-    {
-        for (const auto& w : current.sector.walls)
+        for (const auto& light : path.sector->lights)
         {
-            if (w.portal and w.portal->sector != current.caller)
+            if ((not bounded or (side(point, boundaryLeft, light) <= 0 and side(boundaryRight, point, light) <= 0)) or
+                (bounded and lightPredicate(boundaryLeft, boundaryRight)))
             {
-                if (current.boundaryLeft and current.boundaryRight)
-                {
-                    P portalStart{*current.boundaryLeft};
-                    P portalEnd{*current.boundaryRight};
-
-                    auto side1 = side({mapX, mapY}, *current.boundaryLeft, {w.xStart, w.yStart});
-                    auto side2 = side(*current.boundaryRight, {mapX, mapY}, {w.xStart, w.yStart});
-                    auto side3 = side({mapX, mapY}, *current.boundaryLeft, {w.xEnd, w.yEnd});
-                    auto side4 = side(*current.boundaryRight, {mapX, mapY}, {w.xEnd, w.yEnd});
-
-                    if (side1 <= 0)
-                    {
-                        portalStart = {w.xStart, w.yStart};
-                    }
-                    if (side4 <= 0)
-                    {
-                        portalEnd = {w.xEnd, w.yEnd};
-                    }
-
-                    if (side2 <= 0 and side3 <= 0)
-                    {
-                        gatheringQueue.emplace(GatheredSector{level.sector(w.portal->sector),
-                                                              portalStart,
-                                                              portalEnd,
-                                                              current.sector.id,
-                                                              current.depth - 1});
-                    }
-                }
-                else
-                {
-                    gatheringQueue.emplace(GatheredSector{level.sector(w.portal->sector),
-                                                          P{w.xStart, w.yStart},
-                                                          P{w.xEnd, w.yEnd},
-                                                          current.sector.id,
-                                                          current.depth - 1});
-                }
+                lightVisitor(light, *path.sector);
             }
         }
     }
-
-    gatheringQueue.pop();
 }
 
 LightPoint Lighting::calculateSpriteLighting(const world::Sector& sector,
                                              const world::Sprite& sprite,
                                              const game::Position& player)
+{
+    const auto& staticLighting = staticMaps(sector).sprites[std::distance(sector.sprites.data(), &sprite)];
+
+    double deltaX = sprite.x - player.x;
+    double deltaY = sprite.y - player.y;
+    double deltaZ = sprite.z - sprite.h / 2 + sprite.lightCenter - player.z;
+
+    return staticLighting + playerWallLight * (1 / (deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ));
+}
+
+LightPoint Lighting::bakeSpriteLighting(const world::Sector& sector, const world::Sprite& sprite)
 {
     LightPoint lightPoint{};
 
@@ -357,13 +615,11 @@ LightPoint Lighting::calculateSpriteLighting(const world::Sector& sector,
         double deltaY = sprite.y - light.y;
         double deltaZ = sprite.z - sprite.h / 2 + sprite.lightCenter - light.z;
 
-        double distanceFactor = 1 / (deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ);
+        double distanceFactor = attenuation(light, deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ);
 
         lightPoint += distanceFactor* LightPoint{light.r, light.g, light.b};
     };
 
-    addLight(world::Light{player.x, player.y, player.z, 0.3, 0.3, 0.375});
-
     for (const auto& light : sector.lights)
     {
         addLight(light);
@@ -393,47 +649,47 @@ LightPoint Lighting::calculateSpriteLighting(const world::Sector& sector,
 }
 
 void Lighting::addLight(LightPoint& target,
-                        const world::Sector& sector,
+                        const ShadowCasters& casters,
                         const world::Light& light,
-                        const game::Position& player,
                         double worldX,
                         double worldY,
                         double worldZ)
 {
+    // Shadow casters are unit wide, so none further than half a unit from the light ray can block it
+    constexpr static auto casterReach = 0.5;
+
     double deltaX       = worldX - light.x;
     double deltaY       = worldY - light.y;
     double deltaZ       = worldZ - light.z;
     double distancePart = deltaX * deltaX + deltaY * deltaY;
 
-    auto castsShadows = [](const world::Sprite& sprite) { return sprite.shadows; };
+    double distanceFactor = attenuation(light, distancePart + deltaZ * deltaZ);
+    if (distanceFactor <= 0)
+    {
+        return;
+    }
 
-    auto playerShadow = world::Sprite{-1, {{0, "sprites/shadow"}}, player.x, player.y, player.z, 1.0, 1.0, 0, true};
-    (void)playerShadow;
+    auto minX = std::min(worldX, light.x) - casterReach;
+    auto maxX = std::max(worldX, light.x) + casterReach;
+    auto minY = std::min(worldY, light.y) - casterReach;
+    auto maxY = std::max(worldY, light.y) + casterReach;
 
-    std::vector<std::reference_wrapper<const world::Sprite>> sprites{/*std::ref(playerShadow)*/};
-    std::copy_if(sector.sprites.begin(), sector.sprites.end(), std::back_inserter(sprites), castsShadows);
-    for (const auto& wall : sector.walls)
+    for (const auto& caster : casters)
     {
-        if (wall.portal)
+        if (caster.x < minX or caster.x > maxX or caster.y < minY or caster.y > maxY)
         {
-            const auto& neighbour = level.sector(wall.portal->sector);
-            std::copy_if(neighbour.sprites.begin(), neighbour.sprites.end(), std::back_inserter(sprites), castsShadows);
+            continue;
         }
-    }
-
-    for (const auto& spriteRef : sprites)
-    {
-        const auto& sprite = spriteRef.get();
 
         P a{worldX, worldY};
         P b{light.x, light.y};
 
-        double xDiff    = light.x - sprite.x;
-        double yDiff    = light.y - sprite.y;
+        double xDiff    = light.x - caster.x;
+        double yDiff    = light.y - caster.y;
         double distance = 1 / (2 * std::hypot(xDiff, yDiff));
 
-        P c{sprite.x - yDiff * distance, sprite.y + xDiff * distance};
-        P d{sprite.x + yDiff * distance, sprite.y - xDiff * distance};
+        P c{caster.x - yDiff * distance, caster.y + xDiff * distance};
+        P d{caster.x + yDiff * distance, caster.y - xDiff * distance};
 
         if (intersects(a, b, c, d))
         {
@@ -442,20 +698,19 @@ void Lighting::addLight(LightPoint& target,
             auto wallDistance                   = std::sqrt(distancePart);
             auto ratio                          = intersectionDistance / wallDistance;
             auto intersectionZ                  = light.z + deltaZ * ratio;
-            auto spriteTop = sprite.z + sprite.h / 2, spriteBottom = sprite.z - sprite.h / 2;
-            if (intersectionZ > spriteTop or intersectionZ <= spriteBottom)
+            if (intersectionZ > caster.top or intersectionZ <= caster.bottom)
             {
                 continue;
             }
 
-            const auto& texture = this->getTexture(sprite.texture(0));
+            const auto& texture = this->getTexture(caster.texture);
 
             int spriteX = std::clamp(
                 (int)((intersectionX - c.x + intersectionY - c.y) * (texture.width - 1) / (d.x - c.x + d.y - c.y)),
                 0,
                 texture.width - 1);
             int spriteY = std::clamp(
-                (int)((sprite.h * (spriteTop - intersectionZ) / (spriteTop - spriteBottom)) * (texture.height - 1)),
+                (int)((caster.h * (caster.top - intersectionZ) / (caster.top - caster.bottom)) * (texture.height - 1)),
                 0,
                 texture.height - 1);
 
@@ -468,7 +723,6 @@ void Lighting::addLight(LightPoint& target,
         }
     }
 
-    double distanceFactor = 1 / (distancePart + deltaZ * deltaZ);
     target += distanceFactor* LightPoint{light.r, light.g, light.b};
 }
 } // namespace engine
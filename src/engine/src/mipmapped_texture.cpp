@@ -0,0 +1,89 @@
+#include "mipmapped_texture.hpp"
+
+#include "sdlwrapper/surface.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace engine
+{
+namespace
+{
+constexpr sdl::Pixel opaque = 0xff'00'00'00;
+
+MipmappedTexture::Level emptyLevel(int width, int height)
+{
+    return {width, height, width - 1, height - 1, std::vector<sdl::Pixel>((size_t)(width * height))};
+}
+
+// Averages the opaque ones of the four texels, leaving the result opaque if at least half of them are. This keeps
+// the outline of sprites, which are drawn only where fully opaque, from eroding at lower levels.
+sdl::Pixel downsample(sdl::Pixel topLeft, sdl::Pixel topRight, sdl::Pixel bottomLeft, sdl::Pixel bottomRight)
+{
+    unsigned red = 0, green = 0, blue = 0, count = 0;
+    for (auto texel : {topLeft, topRight, bottomLeft, bottomRight})
+    {
+        if ((texel & opaque) == opaque)
+        {
+            red += (texel >> 16) & 0xff;
+            green += (texel >> 8) & 0xff;
+            blue += texel & 0xff;
+            ++count;
+        }
+    }
+
+    if (count < 2)
+    {
+        return topLeft & ~opaque;
+    }
+
+    return opaque | (red / count << 16) | (green / count << 8) | (blue / count);
+}
+} // namespace
+
+MipmappedTexture::MipmappedTexture(const sdl::Surface& surface)
+{
+    auto base = emptyLevel((int)std::bit_ceil((unsigned)surface.width), (int)std::bit_ceil((unsigned)surface.height));
+
+    const auto* source = surface.pixels();
+    for (int x = 0; x < base.width; ++x)
+    {
+        auto sourceX = x * surface.width / base.width;
+        for (int y = 0; y < base.height; ++y)
+        {
+            auto sourceY                     = y * surface.height / base.height;
+            base.pixels[y + x * base.height] = source[sourceX + sourceY * surface.width];
+        }
+    }
+    levels.push_back(std::move(base));
+
+    while (levels.back().width > 1 or levels.back().height > 1)
+    {
+        const auto& previous = levels.back();
+        auto next            = emptyLevel(std::max(previous.width / 2, 1), std::max(previous.height / 2, 1));
+
+        for (int x = 0; x < next.width; ++x)
+        {
+            for (int y = 0; y < next.height; ++y)
+            {
+                next.pixels[y + x * next.height] = downsample(previous.texel(2 * x, 2 * y),
+                                                              previous.texel(2 * x + 1, 2 * y),
+                                                              previous.texel(2 * x, 2 * y + 1),
+                                                              previous.texel(2 * x + 1, 2 * y + 1));
+            }
+        }
+        levels.push_back(std::move(next));
+    }
+}
+
+int MipmappedTexture::levelFor(double texelsPerPixel) const
+{
+    if (texelsPerPixel < 2)
+    {
+        return 0;
+    }
+
+    return std::clamp(std::ilogb(texelsPerPixel), 0, (int)levels.size() - 1);
+}
+} // namespace engine
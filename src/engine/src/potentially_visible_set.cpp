@@ -0,0 +1,171 @@
+#include "potentially_visible_set.hpp"
+
+#include "thread_pool.hpp"
+#include "utilities.hpp"
+#include "world/level.hpp"
+#include "world/sector.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace engine
+{
+PotentiallyVisibleSet::PotentiallyVisibleSet(const world::Level& level, ThreadPool& pool, int depth)
+    : level(level)
+    , pool(pool)
+    , depth(depth)
+{
+}
+
+void PotentiallyVisibleSet::update()
+{
+    if (revision == level.revision())
+    {
+        return;
+    }
+
+    if (revision.has_value())
+    {
+        SPDLOG_DEBUG("Level revision changed, dropping potentially visible sets");
+    }
+    revision = level.revision();
+    current  = nullptr;
+
+    sectorIndices.clear();
+    sectors.clear();
+    firstWalls.clear();
+    wallCount = 0;
+    for (const auto& [id, sector] : level.sectors())
+    {
+        sectorIndices.emplace(id, (int)sectors.size());
+        sectors.push_back(&sector);
+        firstWalls.push_back(wallCount);
+        wallCount += sector.walls.size();
+    }
+
+    sets.clear();
+    sets.resize(sectors.size());
+}
+
+void PotentiallyVisibleSet::precalculate()
+{
+    update();
+
+    pool.parallelFor(0,
+                     (int)sectors.size(),
+                     1,
+                     [&](int i)
+                     {
+                         if (not sets[i].has_value())
+                         {
+                             sets[i] = calculate(*sectors[i]);
+                         }
+                     });
+
+    SPDLOG_DEBUG("Calculated potentially visible sets of {} sectors", sectors.size());
+}
+
+void PotentiallyVisibleSet::lookFrom(int sector)
+{
+    update();
+
+    auto& set = sets[sectorIndices.at(sector)];
+    if (not set.has_value())
+    {
+        set = calculate(level.sector(sector));
+    }
+    current = &*set;
+}
+
+bool PotentiallyVisibleSet::visible(int sector) const
+{
+    return current->sectors[sectorIndices.at(sector)];
+}
+
+bool PotentiallyVisibleSet::visible(const world::Sector& sector, const world::Wall& wall) const
+{
+    return current->walls[firstWalls[sectorIndices.at(sector.id)] + std::distance(sector.walls.data(), &wall)];
+}
+
+PotentiallyVisibleSet::VisibleSet PotentiallyVisibleSet::calculate(const world::Sector& origin) const
+{
+    VisibleSet set{std::vector<bool>(sectors.size()), std::vector<bool>(wallCount)};
+    std::vector<PortalWindow> portals{};
+    collectChains(set, portals, origin, -1, depth, 0, 0);
+    return set;
+}
+
+void PotentiallyVisibleSet::collectChains(VisibleSet& set,
+                                          std::vector<PortalWindow>& portals,
+                                          const world::Sector& current,
+                                          int caller,
+                                          int remainingDepth,
+                                          double offsetX,
+                                          double offsetY) const
+{
+    auto index         = sectorIndices.at(current.id);
+    set.sectors[index] = true;
+
+    for (size_t i = 0; i < current.walls.size(); ++i)
+    {
+        const auto& wall = current.walls[i];
+
+        // Walls are placed the same way the renderer places them, shifted by all portal transformations on the way
+        portals.push_back(
+            PortalWindow{wall.xStart - offsetX, wall.yStart - offsetY, wall.xEnd - offsetX, wall.yEnd - offsetY});
+        if (stabbable(portals))
+        {
+            set.walls[firstWalls[index] + i] = true;
+
+            // A line of sight crosses a convex sector only once, so it never leads back where it came from
+            if (wall.portal and wall.portal->sector != caller and remainingDepth > 0)
+            {
+                const auto& neighbour = level.sector(wall.portal->sector);
+                const auto& transform = wall.portal->transform;
+                if (not transform.has_value())
+                {
+                    collectChains(set, portals, neighbour, current.id, remainingDepth - 1, offsetX, offsetY);
+                }
+                else if (transform->angle == 0)
+                {
+                    collectChains(set,
+                                  portals,
+                                  neighbour,
+                                  current.id,
+                                  remainingDepth - 1,
+                                  offsetX + transform->x,
+                                  offsetY + transform->y);
+                }
+                else
+                {
+                    std::vector<int> reachedDepths(sectors.size(), -1);
+                    collectReachable(set, reachedDepths, neighbour, remainingDepth - 1);
+                }
+            }
+        }
+        portals.pop_back();
+    }
+}
+
+void PotentiallyVisibleSet::collectReachable(VisibleSet& set,
+                                             std::vector<int>& reachedDepths,
+                                             const world::Sector& current,
+                                             int remainingDepth) const
+{
+    auto index = sectorIndices.at(current.id);
+    if (reachedDepths[index] >= remainingDepth)
+    {
+        return;
+    }
+    reachedDepths[index] = remainingDepth;
+    set.sectors[index]   = true;
+
+    for (size_t i = 0; i < current.walls.size(); ++i)
+    {
+        set.walls[firstWalls[index] + i] = true;
+        if (current.walls[i].portal and remainingDepth > 0)
+        {
+            collectReachable(set, reachedDepths, level.sector(current.walls[i].portal->sector), remainingDepth - 1);
+        }
+    }
+}
+} // namespace engine
@@ -0,0 +1,41 @@
+#include "resolution_controller.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace engine
+{
+namespace
+{
+constexpr auto headroom = 1.2;
+constexpr auto damping  = 0.25;
+} // namespace
+
+ResolutionController::ResolutionController(double targetTime, double minimumScale)
+    : targetTime((uint64_t)(std::max(targetTime, 0.0) * 1'000'000))
+    , minimumScale(std::clamp(minimumScale, 0.1, 1.0))
+{
+}
+
+void ResolutionController::update(uint64_t renderTime)
+{
+    if (targetTime == 0 or renderTime == 0)
+    {
+        return;
+    }
+
+    auto ratio = (double)targetTime / (double)renderTime;
+    if (ratio >= 1 and ratio <= headroom)
+    {
+        return;
+    }
+
+    auto idealScale = currentScale * std::sqrt(ratio);
+    currentScale    = std::clamp(currentScale + (idealScale - currentScale) * damping, minimumScale, 1.0);
+}
+
+double ResolutionController::scale() const
+{
+    return currentScale;
+}
+} // namespace engine
@@ -0,0 +1,151 @@
+#include "shading.hpp"
+
+#include "lighting.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) or defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace engine
+{
+namespace
+{
+#if defined(__AVX2__)
+constexpr auto lanes = 8;
+
+template<int shift>
+__m256i shadeChannel(__m256i pixels, __m256 light)
+{
+    auto value   = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, shift), _mm256_set1_epi32(0xff)));
+    auto clamped = _mm256_min_ps(_mm256_max_ps(light, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+    return _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(value, clamped)), shift);
+}
+
+void shadeBlock(const sdl::Pixel* texels, __m256 r, __m256 g, __m256 b, sdl::Pixel* target)
+{
+    auto pixels = _mm256_loadu_si256((const __m256i*)texels);
+    auto shaded = _mm256_or_si256(_mm256_or_si256(shadeChannel<16>(pixels, r), shadeChannel<8>(pixels, g)),
+                                  shadeChannel<0>(pixels, b));
+    _mm256_storeu_si256((__m256i*)target, shaded);
+}
+
+int shadeVectorized(const sdl::Pixel* texels, const LightSamples& light, int count, sdl::Pixel* target)
+{
+    int i = 0;
+    for (; i + lanes <= count; i += lanes)
+    {
+        shadeBlock(&texels[i],
+                   _mm256_load_ps(&light.r[i]),
+                   _mm256_load_ps(&light.g[i]),
+                   _mm256_load_ps(&light.b[i]),
+                   &target[i]);
+    }
+    return i;
+}
+
+int shadeVectorized(const sdl::Pixel* texels, const LightPoint& light, int count, sdl::Pixel* target)
+{
+    auto r = _mm256_set1_ps((float)light.r);
+    auto g = _mm256_set1_ps((float)light.g);
+    auto b = _mm256_set1_ps((float)light.b);
+
+    int i = 0;
+    for (; i + lanes <= count; i += lanes)
+    {
+        shadeBlock(&texels[i], r, g, b, &target[i]);
+    }
+    return i;
+}
+#elif defined(__SSE2__) or defined(_M_X64)
+constexpr auto lanes = 4;
+
+template<int shift>
+__m128i shadeChannel(__m128i pixels, __m128 light)
+{
+    auto value   = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, shift), _mm_set1_epi32(0xff)));
+    auto clamped = _mm_min_ps(_mm_max_ps(light, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(value, clamped)), shift);
+}
+
+void shadeBlock(const sdl::Pixel* texels, __m128 r, __m128 g, __m128 b, sdl::Pixel* target)
+{
+    auto pixels = _mm_loadu_si128((const __m128i*)texels);
+    auto shaded =
+        _mm_or_si128(_mm_or_si128(shadeChannel<16>(pixels, r), shadeChannel<8>(pixels, g)), shadeChannel<0>(pixels, b));
+    _mm_storeu_si128((__m128i*)target, shaded);
+}
+
+int shadeVectorized(const sdl::Pixel* texels, const LightSamples& light, int count, sdl::Pixel* target)
+{
+    int i = 0;
+    for (; i + lanes <= count; i += lanes)
+    {
+        shadeBlock(&texels[i],
+                   _mm_load_ps(&light.r[i]),
+                   _mm_load_ps(&light.g[i]),
+                   _mm_load_ps(&light.b[i]),
+                   &target[i]);
+    }
+    return i;
+}
+
+int shadeVectorized(const sdl::Pixel* texels, const LightPoint& light, int count, sdl::Pixel* target)
+{
+    auto r = _mm_set1_ps((float)light.r);
+    auto g = _mm_set1_ps((float)light.g);
+    auto b = _mm_set1_ps((float)light.b);
+
+    int i = 0;
+    for (; i + lanes <= count; i += lanes)
+    {
+        shadeBlock(&texels[i], r, g, b, &target[i]);
+    }
+    return i;
+}
+#else
+int shadeVectorized(const sdl::Pixel*, const LightSamples&, int, sdl::Pixel*)
+{
+    return 0;
+}
+
+int shadeVectorized(const sdl::Pixel*, const LightPoint&, int, sdl::Pixel*)
+{
+    return 0;
+}
+#endif
+} // namespace
+
+void shadePixels(const sdl::Pixel* texels, const LightSamples& light, int count, sdl::Pixel* target)
+{
+    for (int i = shadeVectorized(texels, light, count, target); i < count; ++i)
+    {
+        target[i] = shadeRgb(texels[i], light.r[i], light.g[i], light.b[i]);
+    }
+}
+
+void shadePixels(const sdl::Pixel* texels, const LightPoint& light, int count, sdl::Pixel* target)
+{
+    for (int i = shadeVectorized(texels, light, count, target); i < count; ++i)
+    {
+        target[i] = shadeRgb(texels[i], light.r, light.g, light.b);
+    }
+}
+
+void shadePixelsScalar(const sdl::Pixel* texels, const LightSamples& light, int count, sdl::Pixel* target)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        target[i] = shadeRgb(texels[i], light.r[i], light.g[i], light.b[i]);
+    }
+}
+
+void shadePixelsScalar(const sdl::Pixel* texels, const LightPoint& light, int count, sdl::Pixel* target)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        target[i] = shadeRgb(texels[i], light.r, light.g, light.b);
+    }
+}
+} // namespace engine
@@ -0,0 +1,121 @@
+#include "surface_cache.hpp"
+
+#include <spdlog/spdlog.h>
+#include <utility>
+
+namespace engine
+{
+namespace
+{
+// Surfaces larger than this part of the budget are not worth evicting everything else for
+constexpr auto largestSurfaceShare = 4;
+
+uint64_t makeKey(int sector, int surface, int mipLevel)
+{
+    return ((uint64_t)(uint32_t)sector << 32) | ((uint64_t)(uint16_t)surface << 8) | (uint8_t)mipLevel;
+}
+} // namespace
+
+SurfaceCache::SurfaceCache(size_t budget)
+    : budget(budget)
+{
+}
+
+bool SurfaceCache::enabled() const
+{
+    return budget > 0;
+}
+
+bool SurfaceCache::fits(int width, int height) const
+{
+    return (size_t)width * height * sizeof(sdl::Pixel) <= budget / largestSurfaceShare;
+}
+
+void SurfaceCache::invalidate(uint64_t currentRevision)
+{
+    std::lock_guard lock{mutex};
+    if (revision != currentRevision)
+    {
+        SPDLOG_DEBUG("Level revision changed, dropping {} cached surfaces", entries.size());
+        entries.clear();
+        recentlyUsed.clear();
+        requests.clear();
+        requested.clear();
+        used     = 0;
+        revision = currentRevision;
+    }
+}
+
+void SurfaceCache::invalidateSector(int sector)
+{
+    std::lock_guard lock{mutex};
+    for (auto position = recentlyUsed.begin(); position != recentlyUsed.end();)
+    {
+        auto key = *position;
+        if ((int)(key >> 32) != sector)
+        {
+            ++position;
+            continue;
+        }
+
+        used -= entries[key].size;
+        entries.erase(key);
+        position = recentlyUsed.erase(position);
+    }
+}
+
+std::shared_ptr<const SurfaceCache::LitSurface> SurfaceCache::find(int sector, int surface, int mipLevel)
+{
+    auto key = makeKey(sector, surface, mipLevel);
+
+    std::lock_guard lock{mutex};
+    if (auto cached = entries.find(key); cached != entries.end())
+    {
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, cached->second.position);
+        return cached->second.surface;
+    }
+
+    if (requested.insert(key).second)
+    {
+        requests.push_back(Request{sector, surface, mipLevel});
+    }
+    return nullptr;
+}
+
+std::vector<SurfaceCache::Request> SurfaceCache::takeRequests()
+{
+    std::lock_guard lock{mutex};
+    requested.clear();
+    return std::exchange(requests, {});
+}
+
+void SurfaceCache::put(const Request& request, LitSurface surface)
+{
+    auto key  = makeKey(request.sector, request.surface, request.mipLevel);
+    auto size = surface.pixels.size() * sizeof(sdl::Pixel);
+
+    std::lock_guard lock{mutex};
+    auto [entry, inserted] = entries.try_emplace(key);
+    if (not inserted)
+    {
+        return;
+    }
+
+    entry->second.surface  = std::make_shared<const LitSurface>(std::move(surface));
+    entry->second.position = recentlyUsed.insert(recentlyUsed.begin(), key);
+    entry->second.size     = size;
+    used += size;
+    evict();
+}
+
+void SurfaceCache::evict()
+{
+    while (used > budget and recentlyUsed.size() > 1)
+    {
+        auto key = recentlyUsed.back();
+        recentlyUsed.pop_back();
+        used -= entries[key].size;
+        entries.erase(key);
+    }
+}
+} // namespace engine
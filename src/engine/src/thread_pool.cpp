@@ -0,0 +1,157 @@
+#include "thread_pool.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace engine
+{
+namespace
+{
+thread_local int currentWorker = -1;
+} // namespace
+
+ThreadPool::ThreadPool(int threads)
+{
+#if not defined(DISABLE_PARALLELISM)
+    if (threads <= 0)
+    {
+        threads = (int)std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    for (int i = 0; i < threads - 1; ++i)
+    {
+        workers.emplace_back(std::make_unique<Worker>());
+    }
+
+    for (int i = 0; i < (int)workers.size(); ++i)
+    {
+        workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+    }
+#endif
+
+    SPDLOG_INFO("Initialized thread pool with {} threads", size());
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{sleepMutex};
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker->thread.join();
+    }
+}
+
+int ThreadPool::size() const
+{
+    return (int)workers.size() + 1;
+}
+
+void ThreadPool::run(int begin, int end, int grain, const void* context, Invoker invoke)
+{
+    auto jobs = (end - begin + grain - 1) / grain;
+
+    Batch batch{context, invoke, jobs};
+
+    auto target = nextWorker.fetch_add(1, std::memory_order_relaxed);
+    for (int first = begin; first < end; first += grain, ++target)
+    {
+        auto& worker = *workers[target % workers.size()];
+        std::lock_guard lock{worker.mutex};
+        worker.jobs.push_back(Job{&batch, first, std::min(first + grain, end)});
+    }
+
+    {
+        std::lock_guard lock{sleepMutex};
+        queued += jobs;
+    }
+    wakeUp.notify_all();
+
+    while (batch.remaining.load(std::memory_order_acquire) > 0)
+    {
+        if (not runOne(currentWorker))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ThreadPool::runOne(int self)
+{
+    Job job{};
+    if (not pop(self, job) and not steal(self, job))
+    {
+        return false;
+    }
+
+    --queued;
+    job.batch->invoke(job.batch->context, job.begin, job.end);
+    job.batch->remaining.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+bool ThreadPool::pop(int self, Job& job)
+{
+    if (self < 0)
+    {
+        return false;
+    }
+
+    auto& worker = *workers[self];
+    std::lock_guard lock{worker.mutex};
+    if (worker.jobs.empty())
+    {
+        return false;
+    }
+
+    job = worker.jobs.back();
+    worker.jobs.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(int self, Job& job)
+{
+    auto count = (int)workers.size();
+    for (int offset = 1; offset <= count; ++offset)
+    {
+        auto victim = (self + offset + count) % count;
+        if (victim == self)
+        {
+            continue;
+        }
+
+        auto& worker = *workers[victim];
+        std::lock_guard lock{worker.mutex};
+        if (not worker.jobs.empty())
+        {
+            job = worker.jobs.front();
+            worker.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int self)
+{
+    currentWorker = self;
+
+    while (true)
+    {
+        if (runOne(self))
+        {
+            continue;
+        }
+
+        std::unique_lock lock{sleepMutex};
+        wakeUp.wait(lock, [this]() { return stopping or queued > 0; });
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+} // namespace engine
@@ -0,0 +1,101 @@
+#include "transpose.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) or defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace engine
+{
+namespace
+{
+#if defined(__AVX2__)
+constexpr auto blockSize = 8;
+
+void transposeBlock(const sdl::Pixel* columns, sdl::Pixel* rows, int width, int height)
+{
+    auto load = [columns, height](int column)
+    { return _mm256_loadu_si256((const __m256i*)(columns + column * height)); };
+
+    auto t0 = _mm256_unpacklo_epi32(load(0), load(1));
+    auto t1 = _mm256_unpackhi_epi32(load(0), load(1));
+    auto t2 = _mm256_unpacklo_epi32(load(2), load(3));
+    auto t3 = _mm256_unpackhi_epi32(load(2), load(3));
+    auto t4 = _mm256_unpacklo_epi32(load(4), load(5));
+    auto t5 = _mm256_unpackhi_epi32(load(4), load(5));
+    auto t6 = _mm256_unpacklo_epi32(load(6), load(7));
+    auto t7 = _mm256_unpackhi_epi32(load(6), load(7));
+
+    auto u0 = _mm256_unpacklo_epi64(t0, t2);
+    auto u1 = _mm256_unpackhi_epi64(t0, t2);
+    auto u2 = _mm256_unpacklo_epi64(t1, t3);
+    auto u3 = _mm256_unpackhi_epi64(t1, t3);
+    auto u4 = _mm256_unpacklo_epi64(t4, t6);
+    auto u5 = _mm256_unpackhi_epi64(t4, t6);
+    auto u6 = _mm256_unpacklo_epi64(t5, t7);
+    auto u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    auto store = [rows, width](int row, __m256i value) { _mm256_storeu_si256((__m256i*)(rows + row * width), value); };
+
+    store(0, _mm256_permute2x128_si256(u0, u4, 0x20));
+    store(1, _mm256_permute2x128_si256(u1, u5, 0x20));
+    store(2, _mm256_permute2x128_si256(u2, u6, 0x20));
+    store(3, _mm256_permute2x128_si256(u3, u7, 0x20));
+    store(4, _mm256_permute2x128_si256(u0, u4, 0x31));
+    store(5, _mm256_permute2x128_si256(u1, u5, 0x31));
+    store(6, _mm256_permute2x128_si256(u2, u6, 0x31));
+    store(7, _mm256_permute2x128_si256(u3, u7, 0x31));
+}
+#elif defined(__SSE2__) or defined(_M_X64)
+constexpr auto blockSize = 4;
+
+void transposeBlock(const sdl::Pixel* columns, sdl::Pixel* rows, int width, int height)
+{
+    auto load = [columns, height](int column) { return _mm_loadu_si128((const __m128i*)(columns + column * height)); };
+
+    auto t0 = _mm_unpacklo_epi32(load(0), load(1));
+    auto t1 = _mm_unpacklo_epi32(load(2), load(3));
+    auto t2 = _mm_unpackhi_epi32(load(0), load(1));
+    auto t3 = _mm_unpackhi_epi32(load(2), load(3));
+
+    auto store = [rows, width](int row, __m128i value) { _mm_storeu_si128((__m128i*)(rows + row * width), value); };
+
+    store(0, _mm_unpacklo_epi64(t0, t1));
+    store(1, _mm_unpackhi_epi64(t0, t1));
+    store(2, _mm_unpacklo_epi64(t2, t3));
+    store(3, _mm_unpackhi_epi64(t2, t3));
+}
+#else
+constexpr auto blockSize = 1;
+
+void transposeBlock(const sdl::Pixel* columns, sdl::Pixel* rows, int, int)
+{
+    *rows = *columns;
+}
+#endif
+} // namespace
+
+void transposeColumns(const sdl::Pixel* columns, sdl::Pixel* rows, int width, int height)
+{
+    auto blocksEndX = width - width % blockSize;
+    auto blocksEndY = height - height % blockSize;
+
+    for (int y = 0; y < blocksEndY; y += blockSize)
+    {
+        for (int x = 0; x < blocksEndX; x += blockSize)
+        {
+            transposeBlock(columns + y + x * height, rows + x + y * width, width, height);
+        }
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        auto firstX = y < blocksEndY ? blocksEndX : 0;
+        for (int x = firstX; x < width; ++x)
+        {
+            rows[x + y * width] = columns[y + x * height];
+        }
+    }
+}
+} // namespace engine
@@ -85,6 +85,7 @@ public:
     void frame(const world::Level& level, double frameTime);
     void animateFov(double fovH, double fovV, uint64_t length);
     [[nodiscard]] const Position& getPosition() const;
+    [[nodiscard]] Position destination(const world::Level& level) const;
 
     [[nodiscard]] int getSanity() const;
     void setSanity(int sanity);
@@ -263,6 +263,11 @@ std::optional<GameMode> ModeInGame::frame(double frameTime)
     engine->frame(player.getPosition());
     engine->draw();
 
+    if (not player.standing())
+    {
+        engine->prefetch(player.destination(world.level(1)));
+    }
+
     return noChange;
 }
 } // namespace game
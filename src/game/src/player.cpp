@@ -37,6 +37,52 @@ double side(double px, double py, double x1, double y1, double x2, double y2)
 {
     return (x2 - x1) * (py - y1) - (y2 - y1) * (px - x1);
 }
+
+// Moves the position in a straight line, crossing portals the same way Player::frame does
+void walk(const world::Level& level, Position& position, double targetX, double targetY)
+{
+    // A one unit step never crosses that many portals, the limit only guards against malformed levels
+    constexpr static auto maxCrossings{8};
+
+    for (int crossing = 0; crossing < maxCrossings; ++crossing)
+    {
+        const auto& sector = level.sector(position.sector);
+        auto portal        = std::ranges::find_if(
+            sector.walls,
+            [&](const auto& wall)
+            {
+                return wall.portal.has_value() and
+                       intersect(position.x,
+                                 position.y,
+                                 targetX,
+                                 targetY,
+                                 wall.xStart,
+                                 wall.yStart,
+                                 wall.xEnd,
+                                 wall.yEnd) and
+                       side(targetX, targetY, wall.xStart, wall.yStart, wall.xEnd, wall.yEnd) < 0;
+            });
+        if (portal == sector.walls.end())
+        {
+            break;
+        }
+
+        position.sector = portal->portal->sector;
+        if (portal->portal->transform.has_value())
+        {
+            const auto& transform = *portal->portal->transform;
+            position.x += transform.x;
+            position.y += transform.y;
+            position.z += transform.z;
+            position.angle += transform.angle;
+            targetX += transform.x;
+            targetY += transform.y;
+        }
+    }
+
+    position.x = targetX;
+    position.y = targetY;
+}
 } // namespace
 
 Player::Player(scripting::Scripting& scripting, int& noiseLevel)
@@ -65,6 +111,27 @@ const Position& Player::getPosition() const
     return position;
 }
 
+Position Player::destination(const world::Level& level) const
+{
+    auto destination = position;
+    if (rotating != 0)
+    {
+        destination.angle = target.angle;
+    }
+
+    if (moving != 0)
+    {
+        walk(level, destination, target.x, target.y);
+    }
+
+    for (auto queued = moves; not queued.empty(); queued.pop())
+    {
+        walk(level, destination, queued.front().x, queued.front().y);
+    }
+
+    return destination;
+}
+
 void Player::place(int sector, double x, double y, double z, double a, double fovH, double fovV)
 {
     position = {sector, x, y, z, a, fovH, fovV};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <optional>
 #include <string>
 
 namespace sdl
@@ -55,7 +56,14 @@ private:
                 double lightCenter,
                 bool blocking);
     void spriteTexture(int sectorId, int id, double angle, std::string texture);
-    void light(int sectorId, double x, double y, double z, double r, double g, double b);
+    void light(int sectorId,
+               double x,
+               double y,
+               double z,
+               double r,
+               double g,
+               double b,
+               std::optional<double> radius);
 
     void changeTexture(int sectorId, int spriteId, std::string texture);
     void loadTexture(std::string texture);
@@ -32,22 +32,31 @@ WorldBindings::WorldBindings(sol::state& lua, world::World& world)
 void WorldBindings::create(
     int sectorId, double floor, std::string floorTexture, double ceiling, std::string ceilingTexture)
 {
+    auto& level = world.level(1);
     world::Sector sector{sectorId, {}, {}, {}, ceiling, floor, std::move(ceilingTexture), std::move(floorTexture)};
-    world.level(1).put(sector);
+    sector.ceilingTextureHandle = level.textureHandle(sector.ceilingTexture);
+    sector.floorTextureHandle   = level.textureHandle(sector.floorTexture);
+    level.put(sector);
 }
 
 void WorldBindings::addWall(int sectorId, std::string texture, double x1, double y1, double x2, double y2)
 {
-    auto& sector = world.level(1).map.at(sectorId);
-    sector.walls.push_back({x1, y1, x2, y2, std::nullopt, std::move(texture)});
+    auto& level  = world.level(1);
+    auto& sector = level.map.at(sectorId);
+    auto handle  = level.textureHandle(texture);
+    sector.walls.push_back({x1, y1, x2, y2, std::nullopt, std::move(texture), handle});
     sector.recalculateBounds();
+    level.modified();
 }
 
 void WorldBindings::addPortal(int sectorId, std::string texture, double x1, double y1, double x2, double y2, int target)
 {
-    auto& sector = world.level(1).map.at(sectorId);
-    sector.walls.push_back({x1, y1, x2, y2, world::Wall::Portal{target, std::nullopt}, std::move(texture)});
+    auto& level  = world.level(1);
+    auto& sector = level.map.at(sectorId);
+    auto handle  = level.textureHandle(texture);
+    sector.walls.push_back({x1, y1, x2, y2, world::Wall::Portal{target, std::nullopt}, std::move(texture), handle});
     sector.recalculateBounds();
+    level.modified();
 }
 
 void WorldBindings::addTransform(int sectorId,
@@ -62,7 +71,9 @@ void WorldBindings::addTransform(int sectorId,
                                  double transformZ,
                                  double transformAngle)
 {
-    auto& sector = world.level(1).map.at(sectorId);
+    auto& level  = world.level(1);
+    auto& sector = level.map.at(sectorId);
+    auto handle  = level.textureHandle(texture);
     sector.walls.push_back(
         {x1,
          y1,
@@ -70,8 +81,10 @@ void WorldBindings::addTransform(int sectorId,
          y2,
          world::Wall::Portal{target,
                              world::Wall::Portal::Transformation{transformX, transformY, transformZ, transformAngle}},
-         std::move(texture)});
+         std::move(texture),
+         handle});
     sector.recalculateBounds();
+    level.modified();
 }
 
 void WorldBindings::sprite(int sectorId,
@@ -85,9 +98,11 @@ void WorldBindings::sprite(int sectorId,
                            double lightCenter,
                            bool blocking)
 {
-    auto& sector = world.level(1).map.at(sectorId);
+    auto& level  = world.level(1);
+    auto& sector = level.map.at(sectorId);
+    auto handle  = level.textureHandle(texture);
     sector.sprites.push_back(world::Sprite{.id          = id,
-                                           .textures    = {{0, std::move(texture)}},
+                                           .textures    = {{0, std::move(texture), handle}},
                                            .x           = x,
                                            .y           = y,
                                            .z           = z,
@@ -97,18 +112,25 @@ void WorldBindings::sprite(int sectorId,
                                            .shadows     = shadows,
                                            .lightCenter = lightCenter,
                                            .blocking    = blocking});
+    level.modified();
 }
 
 void WorldBindings::spriteTexture(int sectorId, int id, double angle, std::string texture)
 {
-    world.level(1).map.at(sectorId).sprites.at(id).textures.push_back({angle, std::move(texture)});
+    auto& level = world.level(1);
+    auto handle = level.textureHandle(texture);
+    level.map.at(sectorId).sprites.at(id).textures.push_back({angle, std::move(texture), handle});
+    level.modified();
 }
 
 void WorldBindings::changeTexture(int sectorId, int spriteId, std::string texture)
 try
 {
-    auto& sector                                    = world.level(1).map.at(sectorId);
-    sector.sprites.at(spriteId).textures[0].texture = std::move(texture);
+    auto& level           = world.level(1);
+    auto& spriteTexture   = level.map.at(sectorId).sprites.at(spriteId).textures[0];
+    spriteTexture.handle  = level.textureHandle(texture);
+    spriteTexture.texture = std::move(texture);
+    level.modified();
 }
 catch (std::exception& e)
 {
@@ -117,13 +139,21 @@ catch (std::exception& e)
 
 void WorldBindings::loadTexture(std::string texture)
 {
-    world.level(1).additionalTextures.emplace(std::move(texture));
+    world.level(1).textureHandle(texture);
 }
 
-void WorldBindings::light(int sectorId, double x, double y, double z, double r, double g, double b)
+void WorldBindings::light(int sectorId,
+                          double x,
+                          double y,
+                          double z,
+                          double r,
+                          double g,
+                          double b,
+                          std::optional<double> radius)
 {
     auto& sector = world.level(1).map.at(sectorId);
-    sector.lights.push_back(world::Light{x, y, z, r, g, b});
+    sector.lights.push_back(world::Light{x, y, z, r, g, b, radius.value_or(0)});
+    world.level(1).modified();
 }
 
 void WorldBindings::interactivePoint(int sectorId, double x, double y, const std::string& script)
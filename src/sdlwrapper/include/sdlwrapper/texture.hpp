@@ -34,6 +34,8 @@ public:
     void setBlendMode(BlendMode blendMode);
 
     void update(uint32_t* pixels);
+    // Updates the top left corner of the texture, from rows of updatedWidth pixels
+    void update(uint32_t* pixels, int updatedWidth, int updatedHeight);
 
 private:
 
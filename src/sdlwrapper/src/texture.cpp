@@ -58,4 +58,14 @@ void Texture::update(uint32_t* pixels)
         throw std::runtime_error{std::format("could not update texture: {}", SDL_GetError())};
     }
 }
+
+void Texture::update(uint32_t* pixels, int updatedWidth, int updatedHeight)
+{
+    SDL_Rect rectangle{0, 0, updatedWidth, updatedHeight};
+    auto result = SDL_UpdateTexture(wrapped, &rectangle, pixels, updatedWidth * static_cast<int>(sizeof(uint32_t)));
+    if (result != Success)
+    {
+        throw std::runtime_error{std::format("could not update texture: {}", SDL_GetError())};
+    }
+}
 } // namespace sdl
@@ -36,7 +36,8 @@ public:
 
 private:
 
-    using DiffApplier = std::function<void(double)>;
+    // Returns whether the level was changed by the applied value
+    using DiffApplier = std::function<bool(double)>;
     template<typename T>
     using VertexGetter = std::function<std::optional<std::tuple<double, double, double, double>>(const T&)>;
     template<typename T>
@@ -19,6 +19,7 @@ public:
     WindowSector(world::Sector& sector,
                  sdl::Font& font,
                  std::function<void(double, double&)> animator,
+                 std::function<void()> onChange,
                  std::optional<WindowTexture>& textureSelector,
                  int x,
                  int y);
@@ -35,6 +36,7 @@ private:
 
     int width, height;
     std::function<void(double, double&)> animator;
+    std::function<void()> onChange;
     std::optional<WindowTexture>& textureSelector;
     sdl::Font& font;
     world::Sector& sector;
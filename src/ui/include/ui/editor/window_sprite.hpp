@@ -25,6 +25,7 @@ public:
                  std::optional<WindowTexture>& textureSelector,
                  int x,
                  int y,
+                 SpriteAction onChange,
                  SpriteAction duplicate,
                  SpriteAction destroy,
                  SpriteAction block);
@@ -48,6 +49,7 @@ private:
     Text& y;
     Text& z;
     Button& blocking;
+    SpriteAction onChange;
     SpriteAction duplicate;
     SpriteAction destroy;
     SpriteAction block;
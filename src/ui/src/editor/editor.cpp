@@ -72,7 +72,7 @@ bool Editor::event(const sdl::event::Event& event)
     return true;
 }
 
-void Editor::enqueue(int length, double startValue, double targetValue, std::function<void(double)> applier)
+void Editor::enqueue(int length, double startValue, double targetValue, DiffApplier applier)
 {
     auto now = sdl::currentTime();
     diffs.emplace_back(Diff{now, now + length, startValue, targetValue, std::move(applier)});
@@ -185,17 +185,16 @@ void Editor::updateMouse()
                             [&, id = id, originalFloor = sector.floorTexture, originalCeiling = sector.ceilingTexture](
                                 double time)
                             {
-                                auto& s = level.map.at(id);
-                                if ((int)(time) % 400 < 200)
-                                {
-                                    s.ceilingTexture = "highlight";
-                                    s.floorTexture   = "highlight";
-                                }
-                                else
-                                {
-                                    s.ceilingTexture = originalCeiling;
-                                    s.floorTexture   = originalFloor;
-                                }
+                                auto& s          = level.map.at(id);
+                                auto highlighted = (int)(time) % 400 < 200;
+                                auto ceiling     = highlighted ? std::string{"highlight"} : originalCeiling;
+                                auto floor       = highlighted ? std::string{"highlight"} : originalFloor;
+
+                                // The level only changes when the highlight blinks, not on every frame
+                                auto changed     = s.ceilingTexture != ceiling or s.floorTexture != floor;
+                                s.ceilingTexture = ceiling;
+                                s.floorTexture   = floor;
+                                return changed;
                             });
                     clicked = false;
                 }
@@ -227,18 +226,29 @@ void Editor::updateMouse()
 
 void Editor::processMapUpdates()
 {
-    auto now = sdl::currentTime();
+    if (diffs.empty())
+    {
+        return;
+    }
+
+    auto now     = sdl::currentTime();
+    auto changed = false;
 
     while (not diffs.empty() and diffs.front().targetTime <= now)
     {
-        diffs.front().applier(diffs.front().targetValue);
+        changed |= diffs.front().applier(diffs.front().targetValue);
         diffs.pop_front();
     }
 
     for (const auto& diff : diffs)
     {
-        diff.applier(diff.startValue + (now - diff.startTime) * (diff.targetValue - diff.startValue) /
-                                           (diff.targetTime - diff.startTime));
+        changed |= diff.applier(diff.startValue + (now - diff.startTime) * (diff.targetValue - diff.startValue) /
+                                                      (diff.targetTime - diff.startTime));
+    }
+
+    if (changed)
+    {
+        level.modified();
     }
 }
 
@@ -333,6 +343,7 @@ void Editor::moveSectorSprites(int id, double diffX, double diffY)
         sprite.x += diffX;
         sprite.y += diffY;
     }
+    level.modified();
 }
 
 void Editor::resizeSector(int id, double left, double right, double top, double bottom)
@@ -348,6 +359,7 @@ void Editor::resizeSector(int id, double left, double right, double top, double
                        std::round(top * 10) / 10,
                        std::round(bottom * 10) / 10,
                        true);
+    level.modified();
 }
 
 void Editor::resizeSingleSector(int id, double left, double right, double top, double bottom, bool recurse)
@@ -664,7 +676,19 @@ void Editor::drawSelectedSector(sdl::Renderer& renderer)
         selectedSectorWindow.emplace(
             sector,
             font,
-            [&](double diff, double& field) { enqueue(500, field, field + diff, [&](auto v) { field = v; }); },
+            [&](double diff, double& field)
+            {
+                enqueue(500,
+                        field,
+                        field + diff,
+                        [&](auto v)
+                        {
+                            auto changed = field != v;
+                            field        = v;
+                            return changed;
+                        });
+            },
+            [this]() { level.modified(); },
             textureWindow,
             rightX + 16,
             topY);
@@ -685,6 +709,7 @@ void Editor::drawSelectedSector(sdl::Renderer& renderer)
                 textureWindow,
                 rightX + 312,
                 topY,
+                [this]() { level.modified(); },
                 [&, this]()
                 {
                     const auto& src = sector.sprites[*selectedSprite];
@@ -699,6 +724,7 @@ void Editor::drawSelectedSector(sdl::Renderer& renderer)
                                                               src.shadows,
                                                               src.lightCenter,
                                                               src.blocking});
+                    level.modified();
                 },
                 [&, this]()
                 {
@@ -712,11 +738,13 @@ void Editor::drawSelectedSector(sdl::Renderer& renderer)
                     {
                         sprite.id = counter++;
                     }
+                    level.modified();
                 },
                 [&, this]()
                 {
                     auto& sprite    = sector.sprites[*selectedSprite];
                     sprite.blocking = not sprite.blocking;
+                    level.modified();
                 });
         }
 
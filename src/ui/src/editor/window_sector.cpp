@@ -9,12 +9,14 @@ namespace ui::editor
 WindowSector::WindowSector(world::Sector& sector,
                            sdl::Font& font,
                            std::function<void(double, double&)> animator,
+                           std::function<void()> onChange,
                            std::optional<WindowTexture>& textureSelector,
                            int x,
                            int y)
     : width(280)
     , height(170 + sector.walls.size() * 20)
     , animator(std::move(animator))
+    , onChange(std::move(onChange))
     , textureSelector(textureSelector)
     , font(font)
     , sector(sector)
@@ -48,7 +50,15 @@ WindowSector::WindowSector(world::Sector& sector,
         16,
         font,
         "Change",
-        [&] { openTextureSelector("", [&sector](std::string t) { sector.ceilingTexture = std::move(t); }); });
+        [&]
+        {
+            openTextureSelector("",
+                                [&sector, this](std::string t)
+                                {
+                                    sector.ceilingTexture = std::move(t);
+                                    this->onChange();
+                                });
+        });
     sectorWindow.add<Button>(
         width - 80,
         103,
@@ -56,7 +66,15 @@ WindowSector::WindowSector(world::Sector& sector,
         16,
         font,
         "Change",
-        [&] { openTextureSelector("", [&sector](std::string t) { sector.floorTexture = std::move(t); }); });
+        [&]
+        {
+            openTextureSelector("",
+                                [&sector, this](std::string t)
+                                {
+                                    sector.floorTexture = std::move(t);
+                                    this->onChange();
+                                });
+        });
 
     sectorWindow.add<Text>(10, 130, font, "Walls:");
 
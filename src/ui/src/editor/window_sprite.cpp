@@ -10,6 +10,7 @@ WindowSprite::WindowSprite(world::Sector& sector,
                            std::optional<WindowTexture>& textureSelector,
                            int x,
                            int y,
+                           SpriteAction onChange,
                            SpriteAction duplicate,
                            SpriteAction destroy,
                            SpriteAction block)
@@ -24,12 +25,22 @@ WindowSprite::WindowSprite(world::Sector& sector,
     , y(spriteWindow.add<Text>(10, 70, font, "Y"))
     , z(spriteWindow.add<Text>(10, 90, font, "Z"))
     , blocking(spriteWindow.add<Button>(30, 150, width - 60, 16, font, "Switch", block))
+    , onChange(std::move(onChange))
     , duplicate(std::move(duplicate))
     , destroy(std::move(destroy))
     , block(std::move(block))
 {
     auto& s = this->sprite;
 
+    auto modify = [this](std::function<void(world::Sprite&)> change)
+    {
+        return [this, change = std::move(change)]()
+        {
+            change(sprite);
+            this->onChange();
+        };
+    };
+
     spriteWindow.add<Text>(10, 5, font, std::format("Selected sprite: {}", sprite.id));
 
     spriteWindow.add<Button>(width - 80,
@@ -41,25 +52,27 @@ WindowSprite::WindowSprite(world::Sector& sector,
                              [&]
                              {
                                  openTextureSelector("sprites",
-                                                     [&s](std::string t) {
+                                                     [&s, this](std::string t)
+                                                     {
                                                          s.textures = {{0, std::format("sprites/{}", std::move(t))}};
+                                                         this->onChange();
                                                      });
                              });
 
-    spriteWindow.add<Button>(width - 40, 53, 30, 16, font, "+1", [&s]() { s.x += 1; });
-    spriteWindow.add<Button>(width - 75, 53, 30, 16, font, "+0.1", [&s]() { s.x += 0.1; });
-    spriteWindow.add<Button>(width - 110, 53, 30, 16, font, "–0.1", [&s]() { s.x -= 0.1; });
-    spriteWindow.add<Button>(width - 145, 53, 30, 16, font, "–1", [&s]() { s.x -= 1; });
+    spriteWindow.add<Button>(width - 40, 53, 30, 16, font, "+1", modify([](auto& s) { s.x += 1; }));
+    spriteWindow.add<Button>(width - 75, 53, 30, 16, font, "+0.1", modify([](auto& s) { s.x += 0.1; }));
+    spriteWindow.add<Button>(width - 110, 53, 30, 16, font, "–0.1", modify([](auto& s) { s.x -= 0.1; }));
+    spriteWindow.add<Button>(width - 145, 53, 30, 16, font, "–1", modify([](auto& s) { s.x -= 1; }));
 
-    spriteWindow.add<Button>(width - 40, 73, 30, 16, font, "+1", [&s]() { s.y += 1; });
-    spriteWindow.add<Button>(width - 75, 73, 30, 16, font, "+0.1", [&s]() { s.y += 0.1; });
-    spriteWindow.add<Button>(width - 110, 73, 30, 16, font, "–0.1", [&s]() { s.y -= 0.1; });
-    spriteWindow.add<Button>(width - 145, 73, 30, 16, font, "–1", [&s]() { s.y -= 1; });
+    spriteWindow.add<Button>(width - 40, 73, 30, 16, font, "+1", modify([](auto& s) { s.y += 1; }));
+    spriteWindow.add<Button>(width - 75, 73, 30, 16, font, "+0.1", modify([](auto& s) { s.y += 0.1; }));
+    spriteWindow.add<Button>(width - 110, 73, 30, 16, font, "–0.1", modify([](auto& s) { s.y -= 0.1; }));
+    spriteWindow.add<Button>(width - 145, 73, 30, 16, font, "–1", modify([](auto& s) { s.y -= 1; }));
 
-    spriteWindow.add<Button>(width - 40, 93, 30, 16, font, "+1", [&s]() { s.z += 1; });
-    spriteWindow.add<Button>(width - 75, 93, 30, 16, font, "+0.1", [&s]() { s.z += 0.1; });
-    spriteWindow.add<Button>(width - 110, 93, 30, 16, font, "–0.1", [&s]() { s.z -= 0.1; });
-    spriteWindow.add<Button>(width - 145, 93, 30, 16, font, "–1", [&s]() { s.z -= 1; });
+    spriteWindow.add<Button>(width - 40, 93, 30, 16, font, "+1", modify([](auto& s) { s.z += 1; }));
+    spriteWindow.add<Button>(width - 75, 93, 30, 16, font, "+0.1", modify([](auto& s) { s.z += 0.1; }));
+    spriteWindow.add<Button>(width - 110, 93, 30, 16, font, "–0.1", modify([](auto& s) { s.z -= 0.1; }));
+    spriteWindow.add<Button>(width - 145, 93, 30, 16, font, "–1", modify([](auto& s) { s.z -= 1; }));
 
     spriteWindow.add<Button>(30, 110, width - 60, 16, font, "Duplicate", duplicate);
     spriteWindow.add<Button>(30, 130, width - 60, 16, font, "Destroy", destroy);
@@ -5,10 +5,20 @@ namespace c
 extern bool renderStats;
 extern bool frameLimit;
 extern double shadowResolution;
+extern int lightingScale;
 extern int shadowDepth;
+extern double coarseShadowResolution;
+extern int coarseShadowDepth;
+extern int workerThreads;
+extern int prefetchThreads;
+extern int renderStrips;
+extern int surfaceCacheSize;
+extern bool deferredLighting;
+extern int renderWidth;
+extern int renderHeight;
+extern double targetFrameTime;
+extern double minimumRenderScale;
 constexpr auto levelSize{32};
-constexpr auto renderWidth{692};
-constexpr auto renderHeight{384};
 constexpr auto windowWidth{1024};
 constexpr auto windowHeight{768};
 
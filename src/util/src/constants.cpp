@@ -18,10 +18,22 @@ void assign(sol::state& lua, const std::string& name, T& value)
 
 namespace c
 {
-bool renderStats        = false;
-bool frameLimit         = true;
-double shadowResolution = 16;
-int shadowDepth         = 4;
+bool renderStats              = false;
+bool frameLimit               = true;
+double shadowResolution       = 16;
+int lightingScale             = 1;
+int shadowDepth               = 4;
+double coarseShadowResolution = 0;
+int coarseShadowDepth         = 1;
+int workerThreads             = 0;
+int prefetchThreads           = 1;
+int renderStrips              = 1;
+int surfaceCacheSize          = 0;
+bool deferredLighting         = false;
+int renderWidth               = 692;
+int renderHeight              = 384;
+double targetFrameTime        = 0;
+double minimumRenderScale     = 0.5;
 
 void loadConfig()
 {
@@ -34,7 +46,19 @@ void loadConfig()
         assign(lua, "renderStats", renderStats);
         assign(lua, "frameLimit", frameLimit);
         assign(lua, "shadowResolution", shadowResolution);
+        assign(lua, "lightingScale", lightingScale);
         assign(lua, "shadowDepth", shadowDepth);
+        assign(lua, "coarseShadowResolution", coarseShadowResolution);
+        assign(lua, "coarseShadowDepth", coarseShadowDepth);
+        assign(lua, "workerThreads", workerThreads);
+        assign(lua, "prefetchThreads", prefetchThreads);
+        assign(lua, "renderStrips", renderStrips);
+        assign(lua, "surfaceCacheSize", surfaceCacheSize);
+        assign(lua, "deferredLighting", deferredLighting);
+        assign(lua, "renderWidth", renderWidth);
+        assign(lua, "renderHeight", renderHeight);
+        assign(lua, "targetFrameTime", targetFrameTime);
+        assign(lua, "minimumRenderScale", minimumRenderScale);
     }
     catch (std::exception& e)
     {
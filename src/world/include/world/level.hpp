@@ -2,10 +2,10 @@
 
 #include "sector.hpp"
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 namespace engine
@@ -50,6 +50,46 @@ public:
 
     [[nodiscard]] const SectorsMap& sectors() const { return map; }
 
+    /**
+     * @brief Marks the level as modified.
+     *
+     * Has to be called after any change to the level contents (geometry, textures,
+     * sprites, lights), so that the data derived from the level, such as cached
+     * light maps, is recalculated.
+     */
+    void modified();
+
+    /**
+     * @brief Returns the level modification counter.
+     * @return Value increased on every Level::modified call.
+     */
+    [[nodiscard]] uint64_t revision() const { return modifications; }
+
+    /**
+     * @brief Returns the handle of a texture.
+     * @param name Texture name.
+     * @return Texture handle.
+     *
+     * Handles are dense, non-negative integers assigned to texture names on the first
+     * request, and they never change while the level exists. They allow the engine to
+     * keep the textures in a flat array instead of looking them up by name.
+     */
+    int textureHandle(const std::string& name);
+
+    /**
+     * @brief Returns the names of all textures with assigned handles.
+     * @return Texture names, indexed by their handles.
+     */
+    [[nodiscard]] const std::vector<std::string>& textureNames() const { return textures; }
+
+    /**
+     * @brief Assigns texture handles to all sectors, walls and sprites.
+     *
+     * Needed after the texture names were changed directly, without resolving the
+     * new handles.
+     */
+    void resolveTextures();
+
     void interaction(int sector, double x, double y, const std::string& script);
     std::optional<std::string> checkScript(int sector, double x, double y) const;
 
@@ -58,8 +98,10 @@ public:
 private:
 
     std::string name{};
-    std::unordered_set<std::string> additionalTextures{};
+    std::vector<std::string> textures{};
+    std::unordered_map<std::string, int> textureHandles{};
     SectorsMap map{};
     std::vector<Interaction> interactions{};
+    uint64_t modifications{0};
 };
 } // namespace world
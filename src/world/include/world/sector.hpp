@@ -67,6 +67,7 @@ public:
     double xStart, yStart, xEnd, yEnd;
     std::optional<Portal> portal{std::nullopt};
     std::string texture{"wall"};
+    int textureHandle{-1};
 
     [[nodiscard]] std::string toLua(int sectorId) const;
 };
@@ -81,6 +82,7 @@ class Sprite
     {
         double angle;
         std::string texture;
+        int handle{-1};
     };
 
 public:
@@ -96,11 +98,20 @@ public:
 
     [[nodiscard]] std::string toLua(int sectorId) const;
     const std::string& texture(double angle) const;
+    int textureHandle(double angle) const;
+
+private:
+
+    const Texture& textureAt(double angle) const;
 };
 
 /**
  * @class Light
  * @brief A light source.
+ *
+ * The light intensity falls off with the squared distance. When the radius is set,
+ * the light additionally fades out smoothly, reaching zero at the radius, and does
+ * not affect anything further away. Zero radius means the light has unlimited range.
  */
 class Light
 {
@@ -108,6 +119,7 @@ public:
 
     double x, y, z;
     double r, g, b;
+    double radius{0};
 
     [[nodiscard]] std::string toLua(int sectorId) const;
 };
@@ -142,6 +154,8 @@ public:
     double floor{0.0};
     std::string ceilingTexture{"ceiling"};
     std::string floorTexture{"floor"};
+    int ceilingTextureHandle{-1};
+    int floorTextureHandle{-1};
 
     Sector(int id,
            std::vector<Wall> walls,
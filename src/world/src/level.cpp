@@ -18,6 +18,42 @@ void Level::put(Sector sector)
         SPDLOG_WARN("Duplicate sector {}", sector.id);
     }
     map.emplace(sector.id, std::move(sector));
+    modified();
+}
+
+void Level::modified()
+{
+    ++modifications;
+}
+
+int Level::textureHandle(const std::string& name)
+{
+    auto [handle, inserted] = textureHandles.try_emplace(name, (int)textures.size());
+    if (inserted)
+    {
+        textures.push_back(name);
+    }
+    return handle->second;
+}
+
+void Level::resolveTextures()
+{
+    for (auto& [_, sector] : map)
+    {
+        sector.ceilingTextureHandle = textureHandle(sector.ceilingTexture);
+        sector.floorTextureHandle   = textureHandle(sector.floorTexture);
+        for (auto& wall : sector.walls)
+        {
+            wall.textureHandle = textureHandle(wall.texture);
+        }
+        for (auto& sprite : sector.sprites)
+        {
+            for (auto& texture : sprite.textures)
+            {
+                texture.handle = textureHandle(texture.texture);
+            }
+        }
+    }
 }
 
 std::string Level::toLua() const
@@ -81,7 +81,7 @@ std::string Sprite::toLua(int sectorId) const
                                    shadows,
                                    lightCenter,
                                    blocking)};
-    for (const auto& [angle, texture] : textures)
+    for (const auto& [angle, texture, _] : textures)
     {
         if (angle <= 0)
         {
@@ -94,6 +94,10 @@ std::string Sprite::toLua(int sectorId) const
 
 std::string Light::toLua(int sectorId) const
 {
+    if (radius > 0)
+    {
+        return std::format("  light_create({},{},{},{},{},{},{},{})\n", sectorId, x, y, z, r, g, b, radius);
+    }
     return std::format("  light_create({},{},{},{},{},{},{})\n", sectorId, x, y, z, r, g, b);
 }
 
@@ -136,12 +140,22 @@ std::string Wall::toLua(int sectorId) const
 }
 
 const std::string& Sprite::texture(double angle) const
+{
+    return textureAt(angle).texture;
+}
+
+int Sprite::textureHandle(double angle) const
+{
+    return textureAt(angle).handle;
+}
+
+const Sprite::Texture& Sprite::textureAt(double angle) const
 {
     if (angle < 0)
     {
         angle += std::numbers::pi * 2.0;
     }
     auto it = std::find_if(textures.begin(), textures.end(), [angle](const auto& t) { return t.angle > angle; });
-    return (--it)->texture;
+    return *(--it);
 }
 } // namespace world